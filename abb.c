@@ -1,49 +1,317 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "abb.h"
 #include <stdio.h>
-#include "pila.h"
+
+#define LARGO_PREFIJO 8
+// Un AVL de esta altura tendría más nodos de los que entran en memoria, así
+// que alcanza para guardar cualquier camino desde la raíz.
+#define ALTURA_MAXIMA 96
+// En un árbol común guardar y borrar anotan de qué lado bajaron en los
+// primeros GIROS_MAXIMOS niveles, un bit por nivel, para después ajustar
+// los tamaños sin volver a comparar claves.
+#define GIROS_MAXIMOS 4096
+// Los nodos se piden de bloques de TAM_BLOQUE bytes, en clases de tamaño
+// múltiplo de UNIDAD_POOL. Los que no entran en la última clase (claves de
+// más de unos 460 bytes) van sueltos, cada uno en un bloque propio.
+#define TAM_BLOQUE (64 * 1024)
+#define UNIDAD_POOL 16
+#define CLASES_POOL 32
+#define SUELTO CLASES_POOL
+// Los nodos de los árboles persistentes no usan el pool: se piden y se
+// liberan sueltos, porque puede liberarlos cualquier hilo.
+#define COMPARTIDO (CLASES_POOL + 1)
+// Las operaciones de conjuntos reparten el trabajo entre hilos solo en
+// subárboles con al menos esta cantidad de elementos entre los dos.
+#define MINIMO_PARALELO (1 << 16)
 
 typedef struct nodo nodo_t;
 
+// La clave se guarda dentro del propio nodo, a continuación de sus campos,
+// así que guardar un elemento pide una sola vez memoria. La altura solo se
+// mantiene en los árboles balanceados; el tamaño (cantidad de nodos del
+// subárbol) en todos, y es 0 en los nodos libres del pool. El prefijo tiene
+// los primeros LARGO_PREFIJO bytes de la clave en un entero (ver
+// prefijo_de), para comparar sin leer la clave en árboles con strcmp. En los
+// árboles persistentes refs cuenta cuántos nodos padre o versiones del
+// árbol apuntan al nodo.
 struct nodo{
 	nodo_t *izq;
 	nodo_t *der;
-	char *clave;
+	uint64_t prefijo;
 	void *dato;
+	size_t tamanio;
+	_Atomic uint32_t refs;
+	uint8_t altura;
+	uint8_t clase;
+	char clave[];
 };
 
+// Los bloques de nodos forman una lista doble, para poder soltar el de un
+// nodo suelto al borrarlo. Los nodos se cortan del primer bloque de la
+// lista; los que se borran pasan a la lista de libres de su clase (enlazada
+// por izq) y se reusan antes de cortar nodos nuevos.
+typedef struct bloque{
+	struct bloque *anterior;
+	struct bloque *siguiente;
+	size_t usado;
+	size_t capacidad;
+	char datos[];
+} bloque_t;
+
+// Los bloques y las listas de libres de los nodos. Un pool es de un solo
+// árbol salvo que los árboles se pasen nodos (ver abb_partir y abb_unir):
+// entonces lo comparten, con la lista de los árboles que lo usan enlazada
+// por pool_siguiente, y se libera con el último.
+typedef struct pool{
+	bloque_t *bloques;
+	nodo_t *libres[CLASES_POOL];
+	abb_t *arboles;
+} pool_t;
+
 typedef struct abb{
 	nodo_t *raiz;
 	abb_comparar_clave_t cmp;
 	abb_destruir_dato_t destruir_dato;
 	size_t cantidad;
+	bool balanceado;
+	bool orden_strcmp;
+	bool persistente;
+	pthread_mutex_t mutex;
+	pool_t *pool;
+	struct abb *pool_anterior;
+	struct abb *pool_siguiente;
 } abb_t;
 
-typedef struct abb_iter{
-	pila_t *pila;
-} abb_iter_t;
+// Arma un entero con los primeros LARGO_PREFIJO bytes de la clave, el
+// primero en la parte más significativa y con ceros después del final. Dos
+// prefijos distintos se ordenan igual que sus claves según strcmp; si son
+// iguales y el último byte es cero, las claves son iguales.
+uint64_t prefijo_de(const char *clave){
+	uint64_t prefijo = 0;
+	bool terminada = false;
+	for (size_t i = 0; i < LARGO_PREFIJO; i++){
+		terminada = terminada || !clave[i];
+		prefijo = prefijo << 8 | (terminada ? 0 : (unsigned char)clave[i]);
+	}
+	return prefijo;
+}
+
+// Compara la clave, cuyo prefijo ya se calculó, con la del nodo. Si el árbol
+// se ordena con strcmp casi siempre alcanza con los prefijos y no se llama
+// a la función de comparación.
+int comparar(const abb_t *arbol, const char *clave, uint64_t prefijo, const nodo_t *nodo){
+	if (!arbol->orden_strcmp) return arbol->cmp(clave, nodo->clave);
+	if (prefijo != nodo->prefijo) return prefijo < nodo->prefijo ? -1 : 1;
+	if (!(prefijo & 0xff)) return 0;
+	return strcmp(clave + LARGO_PREFIJO, nodo->clave + LARGO_PREFIJO);
+}
+
+// Devuelve la clase de los nodos con claves del largo dado, o SUELTO.
+size_t clase_de(size_t largo){
+	size_t clase = (offsetof(nodo_t, clave) + largo) / UNIDAD_POOL;
+	return clase < CLASES_POOL ? clase : SUELTO;
+}
+
+size_t tamanio_clase(size_t clase){
+	return (clase + 1) * UNIDAD_POOL;
+}
+
+// Agrega un bloque con lugar para capacidad bytes de nodos. Si al_principio
+// es true pasa a ser el bloque del que se cortan los nodos; si no, queda
+// detrás de ese.
+bloque_t *bloque_agregar(pool_t *pool, size_t capacidad, bool al_principio){
+	bloque_t *bloque = malloc(sizeof(bloque_t) + capacidad);
+	if (!bloque) return NULL;
+	bloque->usado = 0;
+	bloque->capacidad = capacidad;
+
+	bloque_t *primero = pool->bloques;
+	if (al_principio || !primero){
+		bloque->anterior = NULL;
+		bloque->siguiente = primero;
+		if (primero) primero->anterior = bloque;
+		pool->bloques = bloque;
+	} else {
+		bloque->anterior = primero;
+		bloque->siguiente = primero->siguiente;
+		if (primero->siguiente) primero->siguiente->anterior = bloque;
+		primero->siguiente = bloque;
+	}
+	return bloque;
+}
+
+void bloque_quitar(pool_t *pool, bloque_t *bloque){
+	if (bloque->anterior) bloque->anterior->siguiente = bloque->siguiente;
+	else pool->bloques = bloque->siguiente;
+	if (bloque->siguiente) bloque->siguiente->anterior = bloque->anterior;
+	free(bloque);
+}
+
+// Devuelve un nodo con lugar para una clave del largo dado, sin inicializar.
+nodo_t *nodo_pedir(abb_t *arbol, size_t largo){
+	if (arbol->persistente){
+		nodo_t *nodo = malloc(offsetof(nodo_t, clave) + largo + 1);
+		if (nodo) nodo->clase = COMPARTIDO;
+		return nodo;
+	}
+	pool_t *pool = arbol->pool;
+	size_t clase = clase_de(largo);
+	if (clase == SUELTO){
+		bloque_t *bloque = bloque_agregar(pool, offsetof(nodo_t, clave) + largo + 1, false);
+		if (!bloque) return NULL;
+		bloque->usado = bloque->capacidad;
+		nodo_t *nodo = (nodo_t *)bloque->datos;
+		nodo->clase = SUELTO;
+		return nodo;
+	}
+
+	nodo_t *nodo = pool->libres[clase];
+	if (nodo){
+		pool->libres[clase] = nodo->izq;
+		return nodo;
+	}
+	size_t tam = tamanio_clase(clase);
+	bloque_t *bloque = pool->bloques;
+	if (!bloque || bloque->capacidad - bloque->usado < tam){
+		bloque = bloque_agregar(pool, TAM_BLOQUE, true);
+		if (!bloque) return NULL;
+	}
+	nodo = (nodo_t *)(bloque->datos + bloque->usado);
+	bloque->usado += tam;
+	nodo->clase = (uint8_t)clase;
+	return nodo;
+}
+
+// Devuelve el nodo al pool: los sueltos se liberan con su bloque y el resto
+// queda libre para el próximo nodo de su clase.
+void nodo_liberar(abb_t *arbol, nodo_t *nodo){
+	if (nodo->clase == COMPARTIDO){
+		free(nodo);
+		return;
+	}
+	if (nodo->clase == SUELTO){
+		bloque_quitar(arbol->pool, (bloque_t *)((char *)nodo - offsetof(bloque_t, datos)));
+		return;
+	}
+	nodo->tamanio = 0;
+	nodo->izq = arbol->pool->libres[nodo->clase];
+	arbol->pool->libres[nodo->clase] = nodo;
+}
+
+pool_t *pool_crear(void){
+	pool_t *pool = malloc(sizeof(pool_t));
+	if (!pool) return NULL;
+	pool->bloques = NULL;
+	for (size_t i = 0; i < CLASES_POOL; i++) pool->libres[i] = NULL;
+	pool->arboles = NULL;
+	return pool;
+}
+
+// Agrega el árbol a los que usan el pool.
+void pool_sumar(pool_t *pool, abb_t *arbol){
+	arbol->pool = pool;
+	arbol->pool_anterior = NULL;
+	arbol->pool_siguiente = pool->arboles;
+	if (pool->arboles) pool->arboles->pool_anterior = arbol;
+	pool->arboles = arbol;
+}
+
+// Saca el árbol de los que usan su pool, que no se libera.
+void pool_restar(abb_t *arbol){
+	if (arbol->pool_anterior) arbol->pool_anterior->pool_siguiente = arbol->pool_siguiente;
+	else arbol->pool->arboles = arbol->pool_siguiente;
+	if (arbol->pool_siguiente) arbol->pool_siguiente->pool_anterior = arbol->pool_anterior;
+}
 
-nodo_t *nodo_crear(const char *clave, void *dato){
-	nodo_t *nodo = malloc(sizeof(nodo_t));
+// Pasa a destino los bloques, los nodos libres y los árboles de origen, y
+// libera origen. Los nodos no se mueven.
+void pool_absorber(pool_t *destino, pool_t *origen){
+	if (origen->bloques){
+		bloque_t *ultimo = origen->bloques;
+		while (ultimo->siguiente) ultimo = ultimo->siguiente;
+		ultimo->siguiente = destino->bloques;
+		if (destino->bloques) destino->bloques->anterior = ultimo;
+		destino->bloques = origen->bloques;
+	}
+	for (size_t i = 0; i < CLASES_POOL; i++){
+		if (!origen->libres[i]) continue;
+		nodo_t *ultimo = origen->libres[i];
+		while (ultimo->izq) ultimo = ultimo->izq;
+		ultimo->izq = destino->libres[i];
+		destino->libres[i] = origen->libres[i];
+	}
+	while (origen->arboles){
+		abb_t *arbol = origen->arboles;
+		pool_restar(arbol);
+		pool_sumar(destino, arbol);
+	}
+	free(origen);
+}
+
+nodo_t *nodo_crear(abb_t *arbol, const char *clave, void *dato){
+	size_t largo = strlen(clave);
+	nodo_t *nodo = nodo_pedir(arbol, largo);
 	if (!nodo) return NULL;
 
 	nodo->izq = NULL;
 	nodo->der = NULL;
-	nodo->clave = strdup(clave);
-	if (!nodo->clave) return NULL;
+	nodo->prefijo = prefijo_de(clave);
 	nodo->dato = dato;
-
+	nodo->tamanio = 1;
+	nodo->altura = 1;
+	atomic_init(&nodo->refs, 1);
+	memcpy(nodo->clave, clave, largo + 1);
 	return nodo;
 }
 
-void nodo_destruir(abb_t *arbol, nodo_t *nodo){
-	free(nodo->clave);
-	if (arbol->destruir_dato) arbol->destruir_dato(nodo->dato);
+// Suelta una referencia a un nodo de un árbol persistente. El último en
+// soltarlo lo libera y suelta sus hijos.
+void nodo_soltar(nodo_t *nodo){
+	if (atomic_fetch_sub_explicit(&nodo->refs, 1, memory_order_acq_rel) != 1) return;
+	if (nodo->izq) nodo_soltar(nodo->izq);
+	if (nodo->der) nodo_soltar(nodo->der);
 	free(nodo);
 }
 
+void nodo_tomar(nodo_t *nodo){
+	if (nodo) atomic_fetch_add_explicit(&nodo->refs, 1, memory_order_relaxed);
+}
+
+// Devuelve el nodo del enlace listo para modificarlo. En un árbol
+// persistente, si otra versión también lo usa, lo reemplaza antes por una
+// copia propia que comparte los hijos; así una escritura copia solo el
+// camino que recorre. Devuelve NULL si no pudo copiarlo.
+nodo_t *propio(abb_t *arbol, nodo_t **enlace){
+	nodo_t *nodo = *enlace;
+	if (!arbol->persistente || atomic_load_explicit(&nodo->refs, memory_order_acquire) == 1) return nodo;
+
+	size_t largo = strlen(nodo->clave);
+	nodo_t *copia = malloc(offsetof(nodo_t, clave) + largo + 1);
+	if (!copia) return NULL;
+	copia->izq = nodo->izq;
+	copia->der = nodo->der;
+	copia->prefijo = nodo->prefijo;
+	copia->dato = nodo->dato;
+	copia->tamanio = nodo->tamanio;
+	copia->altura = nodo->altura;
+	copia->clase = COMPARTIDO;
+	atomic_init(&copia->refs, 1);
+	memcpy(copia->clave, nodo->clave, largo + 1);
+	nodo_tomar(copia->izq);
+	nodo_tomar(copia->der);
+
+	*enlace = copia;
+	nodo_soltar(nodo);
+	return copia;
+}
+
 abb_t *abb_crear(abb_comparar_clave_t cmp, abb_destruir_dato_t destruir_dato){
 	abb_t *arbol = malloc(sizeof(abb_t));
 	if (!arbol) return NULL;
@@ -52,26 +320,317 @@ abb_t *abb_crear(abb_comparar_clave_t cmp, abb_destruir_dato_t destruir_dato){
 	arbol->destruir_dato = destruir_dato;
 	arbol->raiz = NULL;
 	arbol->cantidad = 0;
+	arbol->balanceado = false;
+	arbol->orden_strcmp = cmp == strcmp;
+	arbol->persistente = false;
+	pool_t *pool = pool_crear();
+	if (!pool){
+		free(arbol);
+		return NULL;
+	}
+	pool_sumar(pool, arbol);
 
 	return arbol;
 }
 
-void buscar_nodo(abb_t *arbol, const char *clave, nodo_t **actual, nodo_t **anterior){
-	while(*actual){
-		if (0 > (arbol->cmp(clave, (*actual)->clave))){
-			*anterior = *actual;
-			*actual = (*actual)->izq;
-		} else if (0 < (arbol->cmp(clave, (*actual)->clave))){
-			*anterior = *actual;
-			*actual = (*actual)->der;
-		} else break;
+// Los modos se eligen con el árbol vacío: los nodos de un árbol común
+// pueden estar a más de ALTURA_MAXIMA niveles, y los de uno no persistente
+// salen del pool en lugar de pedirse con malloc.
+bool abb_usar_balanceo(abb_t *arbol){
+	if (arbol->balanceado) return true;
+	if (arbol->cantidad != 0) return false;
+	arbol->balanceado = true;
+	return true;
+}
+
+bool abb_usar_persistencia(abb_t *arbol){
+	if (arbol->persistente) return true;
+	if (arbol->cantidad != 0 || arbol->destruir_dato) return false;
+	if (pthread_mutex_init(&arbol->mutex, NULL) != 0) return false;
+	arbol->persistente = true;
+	arbol->balanceado = true;
+	return true;
+}
+
+abb_t *abb_snapshot(abb_t *arbol){
+	if (!arbol->persistente) return NULL;
+	abb_t *version = abb_crear(arbol->cmp, NULL);
+	if (!version) return NULL;
+	if (!abb_usar_persistencia(version)){
+		free(version);
+		return NULL;
 	}
+
+	// Con el lock ningún escritor puede estar modificando la raíz, que a
+	// partir de acá queda compartida y se copia antes de cambiarla.
+	pthread_mutex_lock(&arbol->mutex);
+	version->raiz = arbol->raiz;
+	version->cantidad = arbol->cantidad;
+	nodo_tomar(version->raiz);
+	pthread_mutex_unlock(&arbol->mutex);
+	return version;
+}
+
+int altura(const nodo_t *nodo){
+	return nodo ? nodo->altura : 0;
+}
+
+size_t tamanio(const nodo_t *nodo){
+	return nodo ? nodo->tamanio : 0;
+}
+
+// Recalcula la altura y el tamaño del nodo a partir de los de sus hijos.
+void actualizar(nodo_t *nodo){
+	int izq = altura(nodo->izq);
+	int der = altura(nodo->der);
+	nodo->altura = (uint8_t)((izq > der ? izq : der) + 1);
+	nodo->tamanio = tamanio(nodo->izq) + tamanio(nodo->der) + 1;
+}
+
+nodo_t *rotar_derecha(nodo_t *nodo){
+	nodo_t *izq = nodo->izq;
+	nodo->izq = izq->der;
+	izq->der = nodo;
+	actualizar(nodo);
+	actualizar(izq);
+	return izq;
+}
+
+nodo_t *rotar_izquierda(nodo_t *nodo){
+	nodo_t *der = nodo->der;
+	nodo->der = der->izq;
+	der->izq = nodo;
+	actualizar(nodo);
+	actualizar(der);
+	return der;
+}
+
+// Rebalancea un nodo cuyos subárboles son AVL y difieren en altura a lo
+// sumo en 2. Devuelve la nueva raíz del subárbol. En un árbol persistente
+// los nodos que rota tienen que ser propios: al guardar ya lo son, porque
+// están en el camino, y al borrar los copia antes preparar_rotaciones. Si
+// aun así no pudiera copiarlos, el subárbol queda sin rotar: sigue siendo un
+// ABB válido, pero pierde la garantía de altura del AVL.
+nodo_t *balancear(abb_t *arbol, nodo_t *nodo){
+	actualizar(nodo);
+	int factor = altura(nodo->izq) - altura(nodo->der);
+	if (factor > 1){
+		if (!propio(arbol, &nodo->izq)) return nodo;
+		if (altura(nodo->izq->izq) < altura(nodo->izq->der)){
+			if (!propio(arbol, &nodo->izq->der)) return nodo;
+			nodo->izq = rotar_izquierda(nodo->izq);
+		}
+		return rotar_derecha(nodo);
+	}
+	if (factor < -1){
+		if (!propio(arbol, &nodo->der)) return nodo;
+		if (altura(nodo->der->der) < altura(nodo->der->izq)){
+			if (!propio(arbol, &nodo->der->izq)) return nodo;
+			nodo->der = rotar_derecha(nodo->der);
+		}
+		return rotar_izquierda(nodo);
+	}
+	return nodo;
+}
+
+// Rebalancea de abajo hacia arriba los nodos a los que apuntan los enlaces
+// del camino. Se detiene cuando un subárbol conserva su altura, porque
+// entonces nada cambia más arriba.
+void balancear_camino(abb_t *arbol, nodo_t **camino[], size_t largo){
+	while (largo > 0){
+		nodo_t **enlace = camino[--largo];
+		int anterior = (*enlace)->altura;
+		*enlace = balancear(arbol, *enlace);
+		if ((*enlace)->altura == anterior) return;
+	}
+}
+
+// En un árbol persistente, copia los nodos que balancear_camino podría
+// rotar al borrar, antes de cambiar nada, para que una falta de memoria
+// deje el árbol como estaba en lugar de a medio rebalancear. final es el
+// enlace que sigue al último del camino. Al borrar, solo puede rotarse un
+// nodo cuyo hijo fuera del camino sea un nivel más alto que el del camino;
+// se copian ese hijo y, si la rotación sería doble, su nieto interior.
+bool preparar_rotaciones(abb_t *arbol, nodo_t **camino[], size_t largo, nodo_t **final){
+	if (!arbol->persistente) return true;
+	for (size_t i = 0; i < largo; i++){
+		nodo_t *nodo = *camino[i];
+		nodo_t **siguiente = i + 1 < largo ? camino[i + 1] : final;
+		bool por_izq = siguiente == &nodo->izq;
+		nodo_t **hermano = por_izq ? &nodo->der : &nodo->izq;
+		if (altura(*hermano) != altura(*siguiente) + 1) continue;
+		if (!propio(arbol, hermano)) return false;
+
+		nodo_t **interior = por_izq ? &(*hermano)->izq : &(*hermano)->der;
+		nodo_t *exterior = por_izq ? (*hermano)->der : (*hermano)->izq;
+		if (altura(*interior) > altura(exterior) && !propio(arbol, interior)) return false;
+	}
+	return true;
+}
+
+// Guarda en un árbol balanceado. Baja desde la raíz anotando los enlaces
+// recorridos, así se rebalancea sin punteros al padre ni recursión.
+bool guardar_balanceado(abb_t *arbol, const char *clave, void *dato){
+	nodo_t **camino[ALTURA_MAXIMA];
+	size_t largo = 0;
+	nodo_t **enlace = &arbol->raiz;
+	uint64_t prefijo = prefijo_de(clave);
+
+	while (*enlace){
+		nodo_t *actual = propio(arbol, enlace);
+		if (!actual) return false;
+		int comparacion = comparar(arbol, clave, prefijo, actual);
+		if (comparacion == 0){
+			if (arbol->destruir_dato) arbol->destruir_dato(actual->dato);
+			actual->dato = dato;
+			return true;
+		}
+		if (largo == ALTURA_MAXIMA) return false;
+		camino[largo++] = enlace;
+		enlace = comparacion < 0 ? &actual->izq : &actual->der;
+	}
+
+	nodo_t *nodo = nodo_crear(arbol, clave, dato);
+	if (!nodo) return false;
+	*enlace = nodo;
+	arbol->cantidad++;
+	// El rebalanceo puede cortar antes de la raíz, así que los tamaños del
+	// camino se actualizan todos aparte.
+	for (size_t i = 0; i < largo; i++) (*camino[i])->tamanio++;
+	balancear_camino(arbol, camino, largo);
+	return true;
+}
+
+// Borra de un árbol balanceado. Igual que en el árbol común, un nodo con
+// dos hijos se reemplaza por su predecesor; el camino llega hasta el padre
+// del predecesor para rebalancear desde ahí. En un árbol persistente, si no
+// hay memoria para copiar el camino no borra nada y devuelve NULL.
+void *borrar_balanceado(abb_t *arbol, const char *clave){
+	nodo_t **camino[ALTURA_MAXIMA];
+	size_t largo = 0;
+	nodo_t **enlace = &arbol->raiz;
+	uint64_t prefijo = prefijo_de(clave);
+
+	while (*enlace){
+		if (!propio(arbol, enlace)) return NULL;
+		int comparacion = comparar(arbol, clave, prefijo, *enlace);
+		if (comparacion == 0) break;
+		if (largo == ALTURA_MAXIMA) return NULL;
+		camino[largo++] = enlace;
+		enlace = comparacion < 0 ? &(*enlace)->izq : &(*enlace)->der;
+	}
+	nodo_t *actual = *enlace;
+	if (!actual) return NULL;
+
+	size_t posicion = ALTURA_MAXIMA;
+	if (!actual->izq || !actual->der){
+		if (!preparar_rotaciones(arbol, camino, largo, enlace)) return NULL;
+		*enlace = actual->izq ? actual->izq : actual->der;
+	} else {
+		if (largo == ALTURA_MAXIMA) return NULL;
+		posicion = largo;
+		camino[largo++] = enlace;
+		nodo_t **enlace_r = &actual->izq;
+		while (true){
+			if (!propio(arbol, enlace_r)) return NULL;
+			if (!(*enlace_r)->der) break;
+			if (largo == ALTURA_MAXIMA) return NULL;
+			camino[largo++] = enlace_r;
+			enlace_r = &(*enlace_r)->der;
+		}
+		// El reemplazo ocupa el lugar del nodo borrado con su misma altura y
+		// sus mismos hijos, así que las rotaciones posibles se deciden igual.
+		if (!preparar_rotaciones(arbol, camino, largo, enlace_r)) return NULL;
+		nodo_t *reemplazo = *enlace_r;
+		*enlace_r = reemplazo->izq;
+		reemplazo->izq = actual->izq;
+		reemplazo->der = actual->der;
+		reemplazo->altura = actual->altura;
+		reemplazo->tamanio = actual->tamanio - 1;
+		*enlace = reemplazo;
+		// El enlace al hijo izquierdo del nodo borrado ahora es el del reemplazo.
+		if (largo > posicion + 1) camino[posicion + 1] = &reemplazo->izq;
+	}
+	// Todos los nodos del camino pierden un descendiente, salvo el
+	// reemplazo, que ya tiene su tamaño.
+	for (size_t i = 0; i < largo; i++){
+		if (i != posicion) (*camino[i])->tamanio--;
+	}
+	balancear_camino(arbol, camino, largo);
+
+	void *resultado = actual->dato;
+	nodo_liberar(arbol, actual);
+	arbol->cantidad--;
+	return resultado;
+}
+
+// El lado hacia el que bajó un descenso en cada nivel (1 si fue a la
+// derecha) y la cantidad de niveles que bajó.
+typedef struct giros{
+	uint64_t bits[GIROS_MAXIMOS / 64];
+	size_t largo;
+} giros_t;
+
+// Suma o resta uno al tamaño de los nodos del camino anotado en giros, que
+// va desde la raíz hasta el de la clave sin incluirlo. Si el camino era más
+// largo de lo que entra en giros, lo repite comparando la clave.
+void ajustar_tamanios(abb_t *arbol, const char *clave, const giros_t *giros, bool sumar){
+	nodo_t *actual = arbol->raiz;
+	if (giros->largo <= GIROS_MAXIMOS){
+		for (size_t i = 0; i < giros->largo; i++){
+			if (sumar) actual->tamanio++;
+			else actual->tamanio--;
+			actual = (giros->bits[i / 64] >> (i % 64)) & 1 ? actual->der : actual->izq;
+		}
+		return;
+	}
+
+	uint64_t prefijo = prefijo_de(clave);
+	while (actual){
+		int comparacion = comparar(arbol, clave, prefijo, actual);
+		if (comparacion == 0) return;
+		if (sumar) actual->tamanio++;
+		else actual->tamanio--;
+		actual = comparacion < 0 ? actual->izq : actual->der;
+	}
+}
+
+// Baja desde *actual hasta el nodo de la clave, o hasta NULL si no está,
+// dejando en *anterior el último nodo recorrido antes. Devuelve la última
+// comparación hecha, que dice de qué lado de *anterior va la clave. Si
+// giros no es NULL anota en él el camino.
+int buscar_nodo(const abb_t *arbol, const char *clave, nodo_t **actual, nodo_t **anterior, giros_t *giros){
+	uint64_t prefijo = prefijo_de(clave);
+	int comparacion = 0;
+	if (giros) giros->largo = 0;
+	while (*actual){
+		comparacion = comparar(arbol, clave, prefijo, *actual);
+		if (comparacion == 0) break;
+		*anterior = *actual;
+		*actual = comparacion < 0 ? (*actual)->izq : (*actual)->der;
+		if (!giros) continue;
+		size_t nivel = giros->largo++;
+		if (nivel >= GIROS_MAXIMOS) continue;
+		uint64_t bit = (uint64_t)1 << (nivel % 64);
+		if (comparacion < 0) giros->bits[nivel / 64] &= ~bit;
+		else giros->bits[nivel / 64] |= bit;
+	}
+	return comparacion;
 }
 
 bool abb_guardar(abb_t *arbol, const char *clave, void *dato){
+	if (arbol->persistente){
+		pthread_mutex_lock(&arbol->mutex);
+		bool ok = guardar_balanceado(arbol, clave, dato);
+		pthread_mutex_unlock(&arbol->mutex);
+		return ok;
+	}
+	if (arbol->balanceado) return guardar_balanceado(arbol, clave, dato);
+
 	nodo_t *anterior = NULL;
 	nodo_t *actual = arbol->raiz;
-	buscar_nodo(arbol, clave, &actual, &anterior);
+	giros_t giros;
+	int comparacion = buscar_nodo(arbol, clave, &actual, &anterior, &giros);
 
 	if (actual){
 		if (arbol->destruir_dato) arbol->destruir_dato(actual->dato);
@@ -79,23 +638,24 @@ bool abb_guardar(abb_t *arbol, const char *clave, void *dato){
 		return true;
 	}
 
-	nodo_t* nodo = nodo_crear(clave, dato);
+	nodo_t* nodo = nodo_crear(arbol, clave, dato);
 	if (!nodo) return false;
 	if (!arbol->raiz){
 		arbol->raiz = nodo;
 		arbol->cantidad++;
 		return true;
 	}
-	if (0 > (arbol->cmp(clave, anterior->clave))) anterior->izq = nodo;
+	if (comparacion < 0) anterior->izq = nodo;
 	else anterior->der = nodo;
 	arbol->cantidad++;
+	ajustar_tamanios(arbol, clave, &giros, true);
 	return true;
 }
 
 void *abb_obtener(const abb_t *arbol, const char *clave){
 	nodo_t *anterior = NULL;
 	nodo_t *actual = arbol->raiz;
-	buscar_nodo((abb_t*)arbol, clave, &actual, &anterior);
+	buscar_nodo(arbol, clave, &actual, &anterior, NULL);
 
 	if (!actual) return NULL;
 	return actual->dato;
@@ -104,54 +664,60 @@ void *abb_obtener(const abb_t *arbol, const char *clave){
 bool abb_pertenece(const abb_t *arbol, const char *clave){
 	nodo_t *anterior = NULL;
 	nodo_t *actual = arbol->raiz;
-	buscar_nodo((abb_t*)arbol, clave, &actual, &anterior);
+	buscar_nodo(arbol, clave, &actual, &anterior, NULL);
 
 	if (!actual) return false;
 	return true;
 }
 
 void *abb_borrar(abb_t *arbol, const char *clave){
+	if (arbol->persistente){
+		// Si la clave no está no hace falta copiar el camino.
+		pthread_mutex_lock(&arbol->mutex);
+		void *resultado = abb_pertenece(arbol, clave) ? borrar_balanceado(arbol, clave) : NULL;
+		pthread_mutex_unlock(&arbol->mutex);
+		return resultado;
+	}
+	if (arbol->balanceado) return borrar_balanceado(arbol, clave);
+
 	nodo_t *anterior = NULL;
 	nodo_t *actual = arbol->raiz;
-	buscar_nodo(arbol, clave, &actual, &anterior);
+	giros_t giros;
+	buscar_nodo(arbol, clave, &actual, &anterior, &giros);
 	
 	if (!actual) return NULL;
-	void *resultado;
+	ajustar_tamanios(arbol, clave, &giros, false);
+	nodo_t *reemplazo;
 
 	//sin hijos o con un solo hijo
 	if (!actual->izq || !actual->der){
-		nodo_t* hijo = NULL;
-		if (!actual->izq) hijo = actual->der;
-		else if (!actual->der) hijo = actual->izq;
-		if (actual == arbol->raiz) arbol->raiz = hijo;
-		else {
-			if (0 > (arbol->cmp(clave, anterior->clave))) anterior->izq = hijo;
-			else anterior->der = hijo;
-		}
-		resultado = actual->dato;
-		free(actual->clave);
-		free(actual);
-		arbol->cantidad--;
+		reemplazo = actual->izq ? actual->izq : actual->der;
 
-	//dos hijos
+	//dos hijos: el nodo se reemplaza por su predecesor, que se desengancha
+	//de su lugar; así ninguna clave cambia de nodo
 	} else {
-		nodo_t *r = NULL;
-		nodo_t *actual_r = actual->izq;
-		while(actual_r){
-			r = actual_r;
-			actual_r = actual_r->der;
+		nodo_t *padre_r = actual;
+		reemplazo = actual->izq;
+		while (reemplazo->der){
+			padre_r = reemplazo;
+			padre_r->tamanio--;
+			reemplazo = reemplazo->der;
 		}
-
-		resultado = actual->dato;
-		void* dato_r = r->dato;
-		char* clave_r = strdup(r->clave);
-
-		abb_borrar(arbol, r->clave);
-		free(actual->clave);
-		actual->dato = dato_r;
-		actual->clave = clave_r;
+		if (padre_r != actual){
+			padre_r->der = reemplazo->izq;
+			reemplazo->izq = actual->izq;
+		}
+		reemplazo->der = actual->der;
+		reemplazo->tamanio = actual->tamanio - 1;
 	}
 
+	if (actual == arbol->raiz) arbol->raiz = reemplazo;
+	else if (anterior->izq == actual) anterior->izq = reemplazo;
+	else anterior->der = reemplazo;
+
+	void *resultado = actual->dato;
+	nodo_liberar(arbol, actual);
+	arbol->cantidad--;
 	return resultado;
 }
 
@@ -159,62 +725,346 @@ size_t abb_cantidad(abb_t *arbol){
 	return arbol->cantidad;
 }
 
-void _abb_destruir(abb_t *arbol, nodo_t *nodo){
-	if (!nodo) return;
-	_abb_destruir(arbol, nodo->izq);
-	_abb_destruir(arbol, nodo->der);
-	nodo_destruir(arbol, nodo);
+size_t abb_rango_de(const abb_t *arbol, const char *clave){
+	size_t rango = 0;
+	nodo_t *actual = arbol->raiz;
+	uint64_t prefijo = prefijo_de(clave);
+	while (actual){
+		if (comparar(arbol, clave, prefijo, actual) <= 0) actual = actual->izq;
+		else {
+			rango += tamanio(actual->izq) + 1;
+			actual = actual->der;
+		}
+	}
+	return rango;
 }
 
-void abb_destruir(abb_t *arbol){
+const char *abb_kesimo(const abb_t *arbol, size_t k){
 	nodo_t *actual = arbol->raiz;
-	_abb_destruir(arbol, actual);
+	while (actual){
+		size_t izq = tamanio(actual->izq);
+		if (k == izq) return actual->clave;
+		if (k < izq) actual = actual->izq;
+		else {
+			k -= izq + 1;
+			actual = actual->der;
+		}
+	}
+	return NULL;
+}
+
+// Aplica destruir_dato a los nodos en uso del bloque, recorriéndolo en
+// orden de memoria: los nodos sueltos ocupan su bloque entero y el resto
+// tiene el tamaño de su clase.
+void bloque_destruir_datos(abb_t *arbol, bloque_t *bloque){
+	size_t posicion = 0;
+	while (posicion < bloque->usado){
+		nodo_t *nodo = (nodo_t *)(bloque->datos + posicion);
+		if (nodo->tamanio != 0) arbol->destruir_dato(nodo->dato);
+		posicion += nodo->clase == SUELTO ? bloque->usado : tamanio_clase(nodo->clase);
+	}
+}
+
+// Libera los nodos del subárbol y destruye sus datos sin recursión ni
+// pila: mientras el nodo tenga hijo izquierdo lo rota a la derecha, y si
+// no tiene lo libera y sigue por el derecho. Cada rotación deja un nodo
+// más en la columna derecha, así que son a lo sumo tantas como nodos.
+void destruir_nodos(abb_t *arbol, nodo_t *nodo){
+	while (nodo){
+		if (nodo->izq){
+			nodo_t *izq = nodo->izq;
+			nodo->izq = izq->der;
+			izq->der = nodo;
+			nodo = izq;
+			continue;
+		}
+		nodo_t *der = nodo->der;
+		if (arbol->destruir_dato) arbol->destruir_dato(nodo->dato);
+		nodo_liberar(arbol, nodo);
+		nodo = der;
+	}
+}
+
+size_t hilos_disponibles(void){
+	long procesadores = sysconf(_SC_NPROCESSORS_ONLN);
+	return procesadores > 1 ? (size_t)procesadores : 1;
+}
+
+// Un grupo de hilos que se reparten las tareas 0..cantidad-1 tomando la
+// siguiente de un contador compartido, así uno que termina antes sigue con
+// otra en lugar de esperar.
+typedef struct reparto{
+	void (*trabajar)(void *extra, size_t tarea);
+	void *extra;
+	size_t cantidad;
+	_Atomic size_t siguiente;
+} reparto_t;
+
+void *trabajar_tareas(void *extra){
+	reparto_t *reparto = extra;
+	size_t tarea;
+	while ((tarea = atomic_fetch_add_explicit(&reparto->siguiente, 1, memory_order_relaxed)) < reparto->cantidad){
+		reparto->trabajar(reparto->extra, tarea);
+	}
+	return NULL;
+}
+
+// Resuelve las tareas con hasta hilos hilos, contando el que llama. Si no
+// puede crear alguno, los demás hacen su parte.
+void repartir(size_t cantidad, size_t hilos, void trabajar(void *, size_t), void *extra){
+	reparto_t reparto = {trabajar, extra, cantidad, 0};
+	pthread_t trabajadores[hilos];
+	size_t creados = 0;
+	while (creados + 1 < hilos && creados + 1 < cantidad){
+		if (pthread_create(&trabajadores[creados], NULL, trabajar_tareas, &reparto) != 0) break;
+		creados++;
+	}
+	trabajar_tareas(&reparto);
+	for (size_t i = 0; i < creados; i++) pthread_join(trabajadores[i], NULL);
+}
+
+// Si el árbol es el único que usa su pool, todos los nodos en uso de los
+// bloques son suyos, así que no hace falta recorrerlo: alcanza con liberar
+// los bloques. Si lo comparte, sus nodos vuelven al pool de a uno. Un árbol
+// persistente solo suelta su raíz; los nodos que siguen en otras versiones
+// quedan vivos.
+void abb_destruir(abb_t *arbol){
+	if (arbol->persistente){
+		if (arbol->raiz) nodo_soltar(arbol->raiz);
+		arbol->raiz = NULL;
+		pthread_mutex_destroy(&arbol->mutex);
+	}
+
+	pool_t *pool = arbol->pool;
+	pool_restar(arbol);
+	if (pool->arboles){
+		destruir_nodos(arbol, arbol->raiz);
+		free(arbol);
+		return;
+	}
+	bloque_t *bloque = pool->bloques;
+	while (bloque){
+		bloque_t *siguiente = bloque->siguiente;
+		if (arbol->destruir_dato) bloque_destruir_datos(arbol, bloque);
+		free(bloque);
+		bloque = siguiente;
+	}
+	free(pool);
 	free(arbol);
 }
 
-abb_iter_t *abb_iter_in_crear(const abb_t *arbol){
+void destruir_bloque(void *extra, size_t tarea){
+	abb_t *arbol = ((void **)extra)[0];
+	bloque_t **bloques = ((void **)extra)[1];
+	bloque_destruir_datos(arbol, bloques[tarea]);
+	free(bloques[tarea]);
+}
+
+// Los bloques son independientes entre sí, así que se reparten los bloques
+// y no los subárboles: nadie necesita recorrer el árbol.
+void abb_destruir_en_paralelo(abb_t *arbol){
+	pool_t *pool = arbol->pool;
+	size_t hilos = hilos_disponibles();
+	if (arbol->persistente || !arbol->destruir_dato || pool->arboles != arbol || arbol->pool_siguiente || hilos == 1 || arbol->cantidad < MINIMO_PARALELO){
+		abb_destruir(arbol);
+		return;
+	}
+
+	size_t cantidad = 0;
+	for (bloque_t *bloque = pool->bloques; bloque; bloque = bloque->siguiente) cantidad++;
+	bloque_t **bloques = malloc(sizeof(bloque_t *) * cantidad);
+	if (!bloques){
+		abb_destruir(arbol);
+		return;
+	}
+	cantidad = 0;
+	for (bloque_t *bloque = pool->bloques; bloque; bloque = bloque->siguiente) bloques[cantidad++] = bloque;
+
+	void *extra[] = {arbol, bloques};
+	repartir(cantidad, hilos, destruir_bloque, extra);
+	free(bloques);
+	free(pool);
+	free(arbol);
+}
+
+// Devuelve el arreglo donde está el camino del iterador.
+const void **camino_de(abb_iter_t *iter){
+	return iter->externo ? iter->externo : iter->camino;
+}
+
+// Agrega el nodo al final del camino. Si no entra y no hay memoria para
+// agrandarlo, el iterador sigue sin camino (ver iter_mover).
+void camino_apilar(abb_iter_t *iter, const nodo_t *nodo){
+	if (!iter->con_camino) return;
+	if (iter->largo == iter->capacidad){
+		size_t capacidad = iter->capacidad * 2;
+		const void **externo = realloc(iter->externo, sizeof(void *) * capacidad);
+		if (!externo){
+			iter->con_camino = false;
+			return;
+		}
+		if (!iter->externo) memcpy(externo, iter->camino, sizeof(iter->camino));
+		iter->externo = externo;
+		iter->capacidad = capacidad;
+	}
+	camino_de(iter)[iter->largo++] = nodo;
+}
+
+void camino_vaciar(abb_iter_t *iter){
+	iter->largo = 0;
+	iter->con_camino = true;
+}
+
+// Deja el iterador en el nodo de menor clave mayor que la dada, o en el de
+// mayor clave menor si adelante es false; si incluida es true también sirve
+// la clave misma. El camino queda desde la raíz hasta ese nodo.
+void iter_buscar(abb_iter_t *iter, const char *clave, bool incluida, bool adelante){
+	const abb_t *arbol = iter->arbol;
+	uint64_t prefijo = prefijo_de(clave);
+	const nodo_t *actual = arbol->raiz;
+	const nodo_t *encontrado = NULL;
+	size_t largo_encontrado = 0;
+
+	camino_vaciar(iter);
+	while (actual){
+		int comparacion = comparar(arbol, clave, prefijo, actual);
+		camino_apilar(iter, actual);
+		if (comparacion == 0 && incluida){
+			encontrado = actual;
+			largo_encontrado = iter->largo;
+			break;
+		}
+		if (adelante ? comparacion < 0 : comparacion > 0){
+			encontrado = actual;
+			largo_encontrado = iter->largo;
+		}
+		if (comparacion == 0) actual = adelante ? actual->der : actual->izq;
+		else actual = comparacion < 0 ? actual->izq : actual->der;
+	}
+	iter->actual = encontrado;
+	iter->largo = largo_encontrado;
+}
+
+// Deja el iterador en el mínimo del árbol, o en el máximo si minimo es false.
+void iter_extremo(abb_iter_t *iter, bool minimo){
+	const nodo_t *actual = iter->arbol->raiz;
+	camino_vaciar(iter);
+	iter->actual = NULL;
+	while (actual){
+		camino_apilar(iter, actual);
+		iter->actual = actual;
+		actual = minimo ? actual->izq : actual->der;
+	}
+}
+
+// Pasa al nodo siguiente (o al anterior) usando el camino: baja al extremo
+// del subárbol de ese lado o, si no hay, sube hasta el primer ancestro al
+// que se llega desde el otro lado. Sin camino, lo busca desde la raíz.
+void iter_mover(abb_iter_t *iter, bool adelante){
+	const nodo_t *actual = iter->actual;
+	if (!iter->con_camino){
+		iter_buscar(iter, actual->clave, false, adelante);
+		return;
+	}
+
+	const nodo_t *hijo = adelante ? actual->der : actual->izq;
+	if (hijo){
+		while (hijo){
+			camino_apilar(iter, hijo);
+			iter->actual = hijo;
+			hijo = adelante ? hijo->izq : hijo->der;
+		}
+		if (!iter->con_camino) iter_buscar(iter, actual->clave, false, adelante);
+		return;
+	}
+
+	const void **camino = camino_de(iter);
+	iter->largo--;
+	while (iter->largo > 0){
+		const nodo_t *padre = camino[iter->largo - 1];
+		if ((adelante ? padre->izq : padre->der) == actual) break;
+		actual = padre;
+		iter->largo--;
+	}
+	iter->actual = iter->largo > 0 ? camino[iter->largo - 1] : NULL;
+}
+
+void abb_iter_in_iniciar_rango(abb_iter_t *iter, const abb_t *arbol, const char *desde, const char *hasta){
+	iter->arbol = arbol;
+	iter->externo = NULL;
+	iter->capacidad = ABB_ITER_ALTURA;
+
+	// Las cotas se reemplazan por el primer y el último nodo del rango, así
+	// que avanzar y retroceder no comparan claves.
+	if (hasta) iter_buscar(iter, hasta, true, false);
+	else iter_extremo(iter, false);
+	const nodo_t *ultimo = iter->actual;
+	if (desde) iter_buscar(iter, desde, true, true);
+	else iter_extremo(iter, true);
+	const nodo_t *primero = iter->actual;
+
+	if (!primero || !ultimo || arbol->cmp(primero->clave, ultimo->clave) > 0){
+		primero = NULL;
+		ultimo = NULL;
+		iter->actual = NULL;
+	}
+	iter->primero = primero;
+	iter->ultimo = ultimo;
+}
+
+void abb_iter_in_iniciar(abb_iter_t *iter, const abb_t *arbol){
+	abb_iter_in_iniciar_rango(iter, arbol, NULL, NULL);
+}
+
+abb_iter_t *abb_iter_in_crear_rango(const abb_t *arbol, const char *desde, const char *hasta){
 	abb_iter_t *iter = malloc(sizeof(abb_iter_t));
 	if (!iter) return NULL;
 
-	pila_t *pila = pila_crear();
-	nodo_t *actual = arbol->raiz;
-	while(actual){
-		pila_apilar(pila, actual);
-		actual = actual->izq;
-	}
-	iter->pila = pila;
+	abb_iter_in_iniciar_rango(iter, arbol, desde, hasta);
 	return iter;
 }
 
+abb_iter_t *abb_iter_in_crear(const abb_t *arbol){
+	return abb_iter_in_crear_rango(arbol, NULL, NULL);
+}
+
 bool abb_iter_in_avanzar(abb_iter_t *iter){
-	if (pila_esta_vacia(iter->pila)) return false;
-	nodo_t *desapilado = pila_desapilar(iter->pila);
-	if (desapilado->der){
-		pila_apilar(iter->pila, desapilado->der);
-		nodo_t *actual = desapilado->der->izq;
-		while (actual){
-			pila_apilar(iter->pila, actual);
-			actual = actual->izq;
-		}
-	}
+	if (abb_iter_in_al_final(iter)) return false;
+	if (iter->actual == iter->ultimo) iter->actual = NULL;
+	else iter_mover(iter, true);
+	return true;
+}
+
+bool abb_iter_in_retroceder(abb_iter_t *iter){
+	if (!iter->ultimo || iter->actual == iter->primero) return false;
+	const nodo_t *ultimo = iter->ultimo;
+	if (abb_iter_in_al_final(iter)) iter_buscar(iter, ultimo->clave, true, true);
+	else iter_mover(iter, false);
 	return true;
 }
 
 const char *abb_iter_in_ver_actual(const abb_iter_t *iter){
-	if (pila_esta_vacia(iter->pila)) return NULL;
-	nodo_t *tope = pila_ver_tope(iter->pila);
-	return tope->clave;
+	if (abb_iter_in_al_final(iter)) return NULL;
+	const nodo_t *actual = iter->actual;
+	return actual->clave;
 }
 
 bool abb_iter_in_al_final(const abb_iter_t *iter){
-	return pila_esta_vacia(iter->pila);
+	return iter->actual == NULL;
+}
+
+void abb_iter_in_terminar(abb_iter_t *iter){
+	free(iter->externo);
+	iter->externo = NULL;
 }
 
 void abb_iter_in_destruir(abb_iter_t* iter){
-	pila_destruir(iter->pila);
+	abb_iter_in_terminar(iter);
 	free(iter);
 }
 
+// Recorrido recursivo, solo para subárboles balanceados: su altura es
+// logarítmica, así que la recursión no puede agotar la pila.
 bool _abb_in_order(nodo_t *actual, bool visitar(const char *, void *, void *), void *extra){
 	if (!actual) return true;
 
@@ -225,7 +1075,423 @@ bool _abb_in_order(nodo_t *actual, bool visitar(const char *, void *, void *), v
 	return true;
 }
 
+// Recorrido de Morris, para subárboles comunes, que pueden ser tan altos
+// como elementos tienen: antes de bajar a la izquierda de un nodo enhebra
+// el derecho vacío de su predecesor hacia él, para volver sin pila, y
+// quita el hilo al volver. Si visitar corta el recorrido, sigue solo por
+// donde quedan hilos, sin bajar a subárboles nuevos, hasta sacarlos todos.
+bool recorrer_enhebrando(nodo_t *actual, bool visitar(const char *, void *, void *), void *extra){
+	bool seguir = true;
+	while (actual){
+		if (actual->izq){
+			nodo_t *anterior = actual->izq;
+			while (anterior->der && anterior->der != actual) anterior = anterior->der;
+			if (!anterior->der && seguir){
+				anterior->der = actual;
+				actual = actual->izq;
+				continue;
+			}
+			anterior->der = NULL;
+		}
+		if (seguir) seguir = visitar(actual->clave, actual->dato, extra);
+		actual = actual->der;
+	}
+	return seguir;
+}
+
+// No recibe el árbol como const: en uno común el recorrido escribe los
+// hilos en los nodos mientras dura.
+bool recorrer(abb_t *arbol, nodo_t *nodo, bool visitar(const char *, void *, void *), void *extra){
+	if (arbol->balanceado) return _abb_in_order(nodo, visitar, extra);
+	return recorrer_enhebrando(nodo, visitar, extra);
+}
+
 void abb_in_order(abb_t *arbol, bool visitar(const char *, void *, void *), void *extra){
-	nodo_t *actual = arbol->raiz;
-	_abb_in_order(actual, visitar, extra);
-}
\ No newline at end of file
+	recorrer(arbol, arbol->raiz, visitar, extra);
+}
+
+// Usa el iterador, que solo baja a los subárboles que pueden tener claves
+// dentro del rango y guarda el camino sin recursión.
+void abb_in_order_rango(abb_t *arbol, const char *desde, const char *hasta, bool visitar(const char *, void *, void *), void *extra){
+	abb_iter_t iter;
+	abb_iter_in_iniciar_rango(&iter, arbol, desde, hasta);
+	while (!abb_iter_in_al_final(&iter)){
+		nodo_t *actual = (nodo_t *)iter.actual;
+		if (!visitar(actual->clave, actual->dato, extra)) break;
+		abb_iter_in_avanzar(&iter);
+	}
+	abb_iter_in_terminar(&iter);
+}
+
+// Cantidad máxima de subárboles en que abb_aplicar parte el árbol.
+#define SUBARBOLES_MAXIMOS 256
+
+typedef struct aplicacion{
+	abb_t *arbol;
+	void (*aplicar)(const char *, void *, void *);
+	void *extra;
+	nodo_t **subarboles;
+} aplicacion_t;
+
+bool aplicar_visitando(const char *clave, void *dato, void *extra){
+	aplicacion_t *aplicacion = extra;
+	aplicacion->aplicar(clave, dato, aplicacion->extra);
+	return true;
+}
+
+void aplicar_subarbol(void *extra, size_t tarea){
+	aplicacion_t *aplicacion = extra;
+	recorrer(aplicacion->arbol, aplicacion->subarboles[tarea], aplicar_visitando, aplicacion);
+}
+
+void abb_aplicar(abb_t *arbol, void aplicar(const char *, void *, void *), void *extra){
+	aplicacion_t aplicacion = {arbol, aplicar, extra, NULL};
+	size_t hilos = hilos_disponibles();
+	if (hilos == 1 || arbol->cantidad < MINIMO_PARALELO){
+		recorrer(arbol, arbol->raiz, aplicar_visitando, &aplicacion);
+		return;
+	}
+
+	// Se parte el árbol a lo ancho: cada subárbol de la lista se reemplaza
+	// por sus dos hijos y su raíz se aplica acá, hasta tener unos cuantos
+	// subárboles por hilo para que se repartan parejo.
+	nodo_t *subarboles[SUBARBOLES_MAXIMOS];
+	size_t objetivo = hilos * 8 < SUBARBOLES_MAXIMOS ? hilos * 8 : SUBARBOLES_MAXIMOS;
+	size_t cantidad = 0;
+	size_t primero = 0;
+	subarboles[cantidad++] = arbol->raiz;
+	while (primero < cantidad && cantidad + 2 <= objetivo){
+		nodo_t *nodo = subarboles[primero++];
+		aplicar(nodo->clave, nodo->dato, extra);
+		if (nodo->izq) subarboles[cantidad++] = nodo->izq;
+		if (nodo->der) subarboles[cantidad++] = nodo->der;
+	}
+
+	aplicacion.subarboles = subarboles + primero;
+	repartir(cantidad - primero, hilos, aplicar_subarbol, &aplicacion);
+}
+
+// Arma un árbol perfectamente balanceado con los nodos [inicio, fin) del
+// arreglo, que ya tienen sus claves en orden. Devuelve la raíz.
+nodo_t *armar_balanceado(nodo_t **nodos, size_t inicio, size_t fin){
+	if (inicio == fin) return NULL;
+	size_t medio = inicio + (fin - inicio) / 2;
+	nodo_t *raiz = nodos[medio];
+	raiz->izq = armar_balanceado(nodos, inicio, medio);
+	raiz->der = armar_balanceado(nodos, medio + 1, fin);
+	actualizar(raiz);
+	return raiz;
+}
+
+abb_t *abb_crear_desde_ordenado(const char *claves[], void *datos[], size_t n, abb_comparar_clave_t cmp, abb_destruir_dato_t destruir_dato){
+	for (size_t i = 1; i < n; i++){
+		if (cmp(claves[i - 1], claves[i]) >= 0) return NULL;
+	}
+
+	abb_t *arbol = abb_crear(cmp, NULL);
+	if (!arbol) return NULL;
+	abb_usar_balanceo(arbol);
+	if (n == 0){
+		arbol->destruir_dato = destruir_dato;
+		return arbol;
+	}
+
+	// Se pide de una vez un bloque con lugar para todos los nodos, que
+	// quedan contiguos y en orden.
+	size_t total = 0;
+	for (size_t i = 0; i < n; i++){
+		size_t clase = clase_de(strlen(claves[i]));
+		if (clase != SUELTO) total += tamanio_clase(clase);
+	}
+	nodo_t **nodos = malloc(sizeof(nodo_t *) * n);
+	bool ok = nodos && (total == 0 || bloque_agregar(arbol->pool, total > TAM_BLOQUE ? total : TAM_BLOQUE, true));
+	for (size_t i = 0; ok && i < n; i++){
+		nodos[i] = nodo_crear(arbol, claves[i], datos ? datos[i] : NULL);
+		ok = nodos[i] != NULL;
+	}
+	if (!ok){
+		// Sin función de destrucción los datos, que siguen siendo del
+		// llamador, quedan intactos.
+		free(nodos);
+		abb_destruir(arbol);
+		return NULL;
+	}
+
+	arbol->raiz = armar_balanceado(nodos, 0, n);
+	arbol->cantidad = n;
+	arbol->destruir_dato = destruir_dato;
+	free(nodos);
+	return arbol;
+}
+
+typedef struct volcado{
+	const char **claves;
+	void **datos;
+	size_t cantidad;
+} volcado_t;
+
+bool volcar(const char *clave, void *dato, void *extra){
+	volcado_t *volcado = extra;
+	if (volcado->claves) volcado->claves[volcado->cantidad] = clave;
+	if (volcado->datos) volcado->datos[volcado->cantidad] = dato;
+	volcado->cantidad++;
+	return true;
+}
+
+size_t abb_volcar_ordenado(abb_t *arbol, const char *claves[], void *datos[]){
+	volcado_t volcado = {claves, datos, 0};
+	abb_in_order(arbol, volcar, &volcado);
+	return volcado.cantidad;
+}
+
+// Une dos subárboles AVL con un nodo cuya clave está entre las de ambos.
+// Baja por el borde del más alto hasta un subárbol de la altura del otro,
+// cuelga ahí el nodo y rebalancea al volver, así que cuesta la diferencia
+// de alturas. Devuelve la raíz del resultado.
+nodo_t *juntar(abb_t *arbol, nodo_t *izq, nodo_t *nodo, nodo_t *der){
+	int altura_izq = altura(izq);
+	int altura_der = altura(der);
+	if (altura_izq > altura_der + 1){
+		izq->der = juntar(arbol, izq->der, nodo, der);
+		return balancear(arbol, izq);
+	}
+	if (altura_der > altura_izq + 1){
+		der->izq = juntar(arbol, izq, nodo, der->izq);
+		return balancear(arbol, der);
+	}
+	nodo->izq = izq;
+	nodo->der = der;
+	actualizar(nodo);
+	return nodo;
+}
+
+// Divide el subárbol en los nodos con clave menor y mayor a la dada, que
+// quedan balanceados en menores y mayores. Devuelve el nodo con la clave,
+// ya sin hijos, o NULL si no está.
+nodo_t *dividir(abb_t *arbol, nodo_t *nodo, const char *clave, uint64_t prefijo, nodo_t **menores, nodo_t **mayores){
+	if (!nodo){
+		*menores = NULL;
+		*mayores = NULL;
+		return NULL;
+	}
+	nodo_t *izq = nodo->izq;
+	nodo_t *der = nodo->der;
+	int comparacion = comparar(arbol, clave, prefijo, nodo);
+	if (comparacion == 0){
+		*menores = izq;
+		*mayores = der;
+		nodo->izq = NULL;
+		nodo->der = NULL;
+		actualizar(nodo);
+		return nodo;
+	}
+
+	nodo_t *encontrado;
+	nodo_t *resto;
+	if (comparacion < 0){
+		encontrado = dividir(arbol, izq, clave, prefijo, menores, &resto);
+		*mayores = juntar(arbol, resto, nodo, der);
+	} else {
+		encontrado = dividir(arbol, der, clave, prefijo, &resto, mayores);
+		*menores = juntar(arbol, izq, nodo, resto);
+	}
+	return encontrado;
+}
+
+// Saca el nodo de clave máxima, que devuelve en maximo, y devuelve la raíz
+// del subárbol que queda.
+nodo_t *sacar_maximo(abb_t *arbol, nodo_t *nodo, nodo_t **maximo){
+	if (!nodo->der){
+		*maximo = nodo;
+		return nodo->izq;
+	}
+	nodo->der = sacar_maximo(arbol, nodo->der, maximo);
+	return balancear(arbol, nodo);
+}
+
+// Une dos subárboles sin nodo del medio: el máximo del izquierdo hace de
+// nodo para juntarlos.
+nodo_t *concatenar(abb_t *arbol, nodo_t *izq, nodo_t *der){
+	if (!izq) return der;
+	if (!der) return izq;
+	nodo_t *maximo;
+	izq = sacar_maximo(arbol, izq, &maximo);
+	return juntar(arbol, izq, maximo, der);
+}
+
+typedef enum tipo_operacion{
+	OPERACION_UNION,
+	OPERACION_INTERSECCION,
+	OPERACION_DIFERENCIA,
+} tipo_operacion_t;
+
+// Una operación de conjuntos entre los subárboles a y b. Cada llamada
+// recursiva tiene la suya, así las de un hilo no comparten nada con las de
+// otro salvo los nodos de b, que en la intersección y la diferencia solo se
+// leen. Los nodos que sobran no se liberan durante la operación, porque el
+// pool no es seguro entre hilos: se cuelgan de descartados, un árbol que
+// no respeta el orden y que se encadena por el hijo derecho de
+// ultimo_descartado, y se liberan al final.
+typedef struct operacion{
+	abb_t *arbol;
+	tipo_operacion_t tipo;
+	nodo_t *a;
+	nodo_t *b;
+	size_t hilos;
+	nodo_t *resultado;
+	nodo_t *descartados;
+	nodo_t *ultimo_descartado;
+} operacion_t;
+
+void descartar(operacion_t *operacion, nodo_t *nodo){
+	if (!nodo) return;
+	nodo_t *ultimo = nodo;
+	while (ultimo->der) ultimo = ultimo->der;
+	ultimo->der = operacion->descartados;
+	if (!operacion->descartados) operacion->ultimo_descartado = ultimo;
+	operacion->descartados = nodo;
+}
+
+// Pasa los nodos descartados por la operación parcial a la operación.
+void sumar_descartados(operacion_t *operacion, operacion_t *parcial){
+	if (!parcial->descartados) return;
+	parcial->ultimo_descartado->der = operacion->descartados;
+	if (!operacion->descartados) operacion->ultimo_descartado = parcial->ultimo_descartado;
+	operacion->descartados = parcial->descartados;
+}
+
+void *operar(void *extra);
+
+// Resuelve las dos mitades de la operación. Si quedan hilos y las mitades
+// son grandes, la izquierda se resuelve en un hilo nuevo.
+void operar_mitades(operacion_t *izq, operacion_t *der, size_t elementos){
+	pthread_t hilo;
+	bool paralelo = izq->hilos > 1 && elementos >= MINIMO_PARALELO;
+	if (paralelo){
+		izq->hilos /= 2;
+		der->hilos -= izq->hilos;
+		paralelo = pthread_create(&hilo, NULL, operar, izq) == 0;
+	}
+	if (!paralelo) operar(izq);
+	operar(der);
+	if (paralelo) pthread_join(hilo, NULL);
+}
+
+// Divide y conquista: toma la raíz de uno de los subárboles, parte el
+// otro por su clave, resuelve las mitades por separado y las junta. Como
+// juntar y dividir cuestan lo que la diferencia de alturas, el total es
+// O(m log(n / m + 1)), con m y n los tamaños del menor y del mayor.
+void *operar(void *extra){
+	operacion_t *operacion = extra;
+	abb_t *arbol = operacion->arbol;
+	nodo_t *a = operacion->a;
+	nodo_t *b = operacion->b;
+	operacion->descartados = NULL;
+	if (!a || !b){
+		if (operacion->tipo == OPERACION_UNION) operacion->resultado = a ? a : b;
+		else if (operacion->tipo == OPERACION_DIFERENCIA) operacion->resultado = a;
+		else {
+			operacion->resultado = NULL;
+			descartar(operacion, a);
+		}
+		return NULL;
+	}
+
+	size_t elementos = tamanio(a) + tamanio(b);
+	operacion_t izq = *operacion;
+	operacion_t der = *operacion;
+	nodo_t *medio;
+	if (operacion->tipo == OPERACION_UNION){
+		// La raíz de a queda en el resultado; si b tiene la misma clave,
+		// su dato reemplaza al de a, como en abb_guardar.
+		medio = a;
+		izq.a = a->izq;
+		der.a = a->der;
+		nodo_t *repetido = dividir(arbol, b, a->clave, a->prefijo, &izq.b, &der.b);
+		if (repetido){
+			void *dato = a->dato;
+			a->dato = repetido->dato;
+			repetido->dato = dato;
+			descartar(operacion, repetido);
+		}
+	} else {
+		// Se parte a, que es del árbol, por la raíz de b, que solo se lee.
+		izq.b = b->izq;
+		der.b = b->der;
+		nodo_t *encontrado = dividir(arbol, a, b->clave, b->prefijo, &izq.a, &der.a);
+		medio = operacion->tipo == OPERACION_INTERSECCION ? encontrado : NULL;
+		if (operacion->tipo == OPERACION_DIFERENCIA) descartar(operacion, encontrado);
+	}
+
+	operar_mitades(&izq, &der, elementos);
+	sumar_descartados(operacion, &izq);
+	sumar_descartados(operacion, &der);
+	if (medio) operacion->resultado = juntar(arbol, izq.resultado, medio, der.resultado);
+	else operacion->resultado = concatenar(arbol, izq.resultado, der.resultado);
+	return NULL;
+}
+
+void operar_con(abb_t *arbol, tipo_operacion_t tipo, nodo_t *otra_raiz){
+	operacion_t operacion = {arbol, tipo, arbol->raiz, otra_raiz, hilos_disponibles(), NULL, NULL, NULL};
+	operar(&operacion);
+	arbol->raiz = operacion.resultado;
+	arbol->cantidad = tamanio(arbol->raiz);
+	destruir_nodos(arbol, operacion.descartados);
+}
+
+// Las operaciones de conjuntos parten y juntan subárboles AVL: sobre un
+// árbol común dividir podría recurrir tantas veces como elementos tiene, y
+// sobre uno persistente modificaría nodos compartidos con instantáneas.
+bool operable(const abb_t *arbol){
+	return arbol->balanceado && !arbol->persistente;
+}
+
+bool abb_unir(abb_t *arbol, abb_t *otro){
+	if (otro == arbol || !operable(arbol) || !operable(otro) || otro->cmp != arbol->cmp) return false;
+	// Los nodos de otro pasan a arbol, así que desde ahora comparten pool.
+	if (otro->pool != arbol->pool) pool_absorber(arbol->pool, otro->pool);
+	nodo_t *otra_raiz = otro->raiz;
+	otro->raiz = NULL;
+	abb_destruir(otro);
+	operar_con(arbol, OPERACION_UNION, otra_raiz);
+	return true;
+}
+
+bool abb_intersecar(abb_t *arbol, const abb_t *otro){
+	if (!operable(arbol) || !operable(otro) || otro->cmp != arbol->cmp) return false;
+	if (otro != arbol) operar_con(arbol, OPERACION_INTERSECCION, otro->raiz);
+	return true;
+}
+
+bool abb_diferencia(abb_t *arbol, const abb_t *otro){
+	if (!operable(arbol) || !operable(otro) || otro->cmp != arbol->cmp) return false;
+	if (otro == arbol){
+		destruir_nodos(arbol, arbol->raiz);
+		arbol->raiz = NULL;
+		arbol->cantidad = 0;
+		return true;
+	}
+	operar_con(arbol, OPERACION_DIFERENCIA, otro->raiz);
+	return true;
+}
+
+abb_t *abb_partir(abb_t *arbol, const char *clave){
+	if (!operable(arbol)) return NULL;
+	abb_t *mayores = abb_crear(arbol->cmp, arbol->destruir_dato);
+	if (!mayores) return NULL;
+	abb_usar_balanceo(mayores);
+	// Los nodos de mayores siguen en los bloques de arbol.
+	pool_t *pool = mayores->pool;
+	pool_restar(mayores);
+	free(pool);
+	pool_sumar(arbol->pool, mayores);
+
+	nodo_t *menores;
+	nodo_t *resto;
+	nodo_t *encontrado = dividir(arbol, arbol->raiz, clave, prefijo_de(clave), &menores, &resto);
+	arbol->raiz = menores;
+	arbol->cantidad = tamanio(menores);
+	mayores->raiz = encontrado ? juntar(arbol, NULL, encontrado, resto) : resto;
+	mayores->cantidad = tamanio(mayores->raiz);
+	return mayores;
+}
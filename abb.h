@@ -13,10 +13,63 @@ typedef struct abb_iter abb_iter_t;
 typedef int (*abb_comparar_clave_t) (const char *, const char *);
 typedef void (*abb_destruir_dato_t) (void *);
 
+// El iterador se declara acá para que pueda vivir en la pila de quien lo
+// usa (ver abb_iter_in_iniciar); sus campos son internos. Guarda el camino
+// desde la raíz hasta el nodo actual, que en un árbol balanceado siempre
+// entra en camino; solo un árbol común más alto pide memoria para seguirlo.
+#define ABB_ITER_ALTURA 96
+
+struct abb_iter{
+	const abb_t *arbol;
+	const void *camino[ABB_ITER_ALTURA];
+	const void **externo;
+	size_t largo;
+	size_t capacidad;
+	bool con_camino;
+	const void *actual;
+	const void *primero;
+	const void *ultimo;
+};
+
 
 // Crea el ABB
 abb_t *abb_crear(abb_comparar_clave_t cmp, abb_destruir_dato_t destruir_dato);
 
+// Crea un ABB balanceado (como con abb_usar_balanceo) con los n pares
+// (claves[i], datos[i]) en tiempo lineal, pidiendo todos los nodos en un
+// solo bloque. Si datos es NULL los datos quedan en NULL. Devuelve NULL si
+// las claves no están en orden estrictamente creciente según cmp o si no
+// pudo pedir memoria; en ese caso los datos no se destruyen.
+abb_t *abb_crear_desde_ordenado(const char *claves[], void *datos[], size_t n, abb_comparar_clave_t cmp, abb_destruir_dato_t destruir_dato);
+
+// Hace que el ABB se mantenga balanceado (AVL): guardar y borrar rotan los
+// nodos necesarios para que la altura sea siempre logarítmica, aunque las
+// claves lleguen ordenadas. Buscar, recorrer e iterar no cambian. Devuelve
+// false, sin cambiar el ABB, si no está vacío.
+// Pre: Se creó el ABB
+bool abb_usar_balanceo(abb_t *arbol);
+
+// Hace que el ABB sea persistente: cada escritura copia solo los nodos del
+// camino que modifica y deja intactos los que comparte con instantáneas
+// anteriores (ver abb_snapshot). El ABB queda además balanceado. Guardar y
+// borrar pueden llamarse desde varios hilos; para leer mientras otro hilo
+// escribe hay que hacerlo sobre una instantánea. Como los datos reemplazados
+// o borrados pueden seguir en alguna instantánea, el ABB no los destruye.
+// Devuelve false, sin cambiar el ABB, si no está vacío, si tiene función de
+// destrucción o si no pudo prepararlo.
+// Pre: Se creó el ABB
+bool abb_usar_persistencia(abb_t *arbol);
+
+// Devuelve en O(1) una instantánea de un ABB persistente: otro ABB que
+// comparte los nodos con el original y conserva el contenido de este
+// momento aunque el original siga cambiando. Se lee con las primitivas de
+// siempre (obtener, recorrer, iterar) sin tomar ningún lock ni frenar a los
+// escritores, y se destruye con abb_destruir. Cada nodo cuenta cuántas
+// versiones lo usan y se libera cuando la última lo suelta. Devuelve NULL si
+// el ABB no es persistente o si no pudo pedir memoria.
+// Pre: Se creó el ABB
+abb_t *abb_snapshot(abb_t *arbol);
+
 // Guarda un elemento en el ABB. Si se pasa una clave que ya existe, 
 // se reemplaza el dato. Si no logra guardarlo devuelve false
 // Pre: Se creó el ABB
@@ -46,25 +99,134 @@ bool abb_pertenece(const abb_t *arbol, const char *clave);
 // Post: Se devolvió la cantidad de elementos
 size_t abb_cantidad(abb_t *arbol);
 
+// Devuelve la cantidad de claves del ABB menores que clave, que es la
+// posición que tiene (o tendría) la clave en orden. Recorre un solo camino
+// desde la raíz.
+// Pre: Se creó el ABB
+size_t abb_rango_de(const abb_t *arbol, const char *clave);
+
+// Devuelve la clave en la posición k en orden, contando desde 0, o NULL si
+// k no es menor que la cantidad de elementos. Recorre un solo camino desde
+// la raíz.
+// Pre: Se creó el ABB
+const char *abb_kesimo(const abb_t *arbol, size_t k);
+
 // Destruye el ABB
 // Pre: Se creó el ABB
 // Post: El ABB ha sido destruido
 void abb_destruir(abb_t *arbol);
 
+// Como abb_destruir, pero en un ABB grande destruye los datos desde varios
+// hilos a la vez.
+// Pre: Se creó el ABB y su función de destrucción puede llamarse desde
+// varios hilos a la vez
+// Post: El ABB ha sido destruido
+void abb_destruir_en_paralelo(abb_t *arbol);
+
+// Operaciones de conjuntos entre ABBs balanceados. En lugar de guardar o
+// borrar clave por clave, parten y juntan subárboles enteros: cuestan
+// O(m log(n / m + 1)), con m y n los tamaños del menor y del mayor, que es
+// O(m log n) si uno es chico y O(n) si son parecidos. En árboles grandes
+// reparten el trabajo entre los procesadores disponibles. Solo operan sobre
+// ABBs balanceados (ver abb_usar_balanceo) que no son persistentes y que
+// comparan las claves con la misma función; si no, no cambian nada y
+// devuelven false (o NULL).
+//
+// Los nodos pasan de un árbol a otro sin copiarse, así que los árboles que
+// intercambiaron nodos (con abb_partir o abb_unir) comparten sus bloques,
+// que se liberan con el último. Esos bloques no están protegidos contra
+// accesos simultáneos: árboles que los comparten no pueden modificarse ni
+// destruirse desde hilos distintos al mismo tiempo.
+// Pre (para las cuatro): Se crearon los ABBs
+
+// Agrega a arbol todos los elementos de otro, que queda destruido. Si una
+// clave está en los dos, queda el dato de otro y el de arbol se destruye.
+// Devuelve false, sin cambiar ninguno de los dos, si otro es arbol.
+bool abb_unir(abb_t *arbol, abb_t *otro);
+
+// Deja en arbol solo las claves que también están en otro, con los datos
+// de arbol, y destruye los datos de las demás. otro no cambia.
+bool abb_intersecar(abb_t *arbol, const abb_t *otro);
+
+// Saca de arbol las claves que están en otro y destruye sus datos. otro no
+// cambia.
+bool abb_diferencia(abb_t *arbol, const abb_t *otro);
+
+// Saca de arbol los elementos con clave mayor o igual a clave y los
+// devuelve en un ABB nuevo, con la misma función de destrucción, que
+// comparte los bloques de arbol. Devuelve NULL, sin cambiar arbol, si no
+// pudo pedir memoria.
+abb_t *abb_partir(abb_t *arbol, const char *clave);
+
 // Itera inorder sobre los elementos del ABB aplicandoles la función visitar()
+// No usa más pila que la de una llamada aunque el ABB no esté balanceado:
+// en ese caso enhebra temporalmente los nodos para volver hacia arriba
+// (recorrido de Morris), así que mientras dura visitar no debe usar el ABB
+// y ningún otro hilo puede recorrerlo ni leerlo, aunque sea solo para leer.
 // Pre: El iterador fue creado
 // Post: Se aplicó la función visitar() sobre los elementos del ABB de acuerdo a los parámetros recibidos
 void abb_in_order(abb_t *arbol, bool visitar(const char *, void *, void *), void *extra);
 
+// Aplica aplicar() a todos los elementos del ABB, en cualquier orden. En un
+// ABB grande reparte subárboles entre los procesadores disponibles, así que
+// aplicar puede llamarse desde varios hilos a la vez y no debe usar el ABB.
+// Si el ABB no está balanceado, lo recorre enhebrando sus nodos como
+// abb_in_order, así que tampoco puede usarse desde otro hilo mientras dura.
+// Pre: Se creó el ABB
+// Post: Se aplicó la función aplicar() sobre todos los elementos del ABB
+void abb_aplicar(abb_t *arbol, void aplicar(const char *, void *, void *), void *extra);
+
+// Copia en orden las claves y los datos del ABB a los arreglos, que deben
+// tener lugar para abb_cantidad elementos; cualquiera de los dos puede ser
+// NULL. Las claves son las del ABB y valen mientras no se borren. Devuelve
+// la cantidad de elementos copiados. Junto con abb_crear_desde_ordenado
+// permite guardar y reconstruir el árbol en tiempo lineal. Recorre como
+// abb_in_order: en un ABB no balanceado escribe en los nodos mientras
+// copia, así que no puede llamarse a la vez desde dos hilos.
+// Pre: Se creó el ABB
+size_t abb_volcar_ordenado(abb_t *arbol, const char *claves[], void *datos[]);
+
+// Como abb_in_order, pero solo sobre las claves entre desde y hasta, ambas
+// incluidas. Una cota NULL no limita ese extremo. Solo baja a los subárboles
+// que pueden tener claves del rango.
+// Pre: Se creó el ABB
+// Post: Se aplicó la función visitar() sobre los elementos del rango
+void abb_in_order_rango(abb_t *arbol, const char *desde, const char *hasta, bool visitar(const char *, void *, void *), void *extra);
+
 // Crea un iterador.
 // Post: devuelve un iterador en el primer elemento de la lista.
 abb_iter_t *abb_iter_in_crear(const abb_t *arbol);
 
+// Inicializa un iterador declarado por el llamador, sin pedir memoria, en
+// el primer elemento. Se termina con abb_iter_in_terminar en lugar de
+// abb_iter_in_destruir.
+// Post: el iterador está en el primer elemento del ABB.
+void abb_iter_in_iniciar(abb_iter_t *iter, const abb_t *arbol);
+
+// Como abb_iter_in_iniciar, pero sobre las claves entre desde y hasta, con
+// las mismas reglas que abb_iter_in_crear_rango.
+// Post: el iterador está en la primera clave mayor o igual a desde.
+void abb_iter_in_iniciar_rango(abb_iter_t *iter, const abb_t *arbol, const char *desde, const char *hasta);
+
+// Crea un iterador sobre las claves entre desde y hasta, ambas incluidas.
+// Una cota NULL no limita ese extremo. Llega a la primera clave bajando
+// desde la raíz, sin recorrer las anteriores, y no guarda las cotas.
+// Post: devuelve un iterador en la primera clave mayor o igual a desde; está
+// al final si no hay claves en el rango.
+abb_iter_t *abb_iter_in_crear_rango(const abb_t *arbol, const char *desde, const char *hasta);
+
 // Avanza el iterador y devuelve true, si ya está al final, devuelve false.
 // Pre: El iterador fue creado
 // Post: Si no está en el final, el iterador avanzó.
 bool abb_iter_in_avanzar(abb_iter_t *iter);
 
+// Retrocede el iterador al elemento anterior y devuelve true. Desde el
+// final pasa al último elemento. Si está en el primer elemento (o el rango
+// está vacío) no se mueve y devuelve false.
+// Pre: El iterador fue creado
+// Post: Si no está en el primer elemento, el iterador retrocedió.
+bool abb_iter_in_retroceder(abb_iter_t *iter);
+
 // Devuelve la clave en la posición del iterador
 // Pre: El iterador fue creado
 // Post: Se devolvió la clave del elemento actual del iterador
@@ -78,4 +240,11 @@ bool abb_iter_in_al_final(const abb_iter_t *iter);
 // Destruye el iterador.
 // Pre: El iterador fue creado
 // Post: Se eliminó el iterador.
-void abb_iter_in_destruir(abb_iter_t *iter);
\ No newline at end of file
+void abb_iter_in_destruir(abb_iter_t *iter);
+
+// Libera la memoria que haya pedido un iterador inicializado con
+// abb_iter_in_iniciar; no libera el iterador en sí.
+// Pre: El iterador fue inicializado
+void abb_iter_in_terminar(abb_iter_t *iter);
+
+#endif  // ABB_H
@@ -0,0 +1,486 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "arbol_b.h"
+#include <stdio.h>
+
+// Las funciones auxiliares son static para poder enlazar este árbol junto
+// con abb.c, que usa los mismos nombres.
+
+#define MAX_CLAVES 32
+// Cantidad mínima de claves de un nodo que no es la raíz, salvo que haya
+// faltado memoria al rebalancear un borrado: el árbol sigue siendo correcto
+// con nodos más vacíos, solo menos compacto.
+#define MIN_CLAVES (MAX_CLAVES / 2 - 1)
+#define LARGO_CLAVE_CORTA 15
+
+typedef struct nodo_b nodo_b_t;
+
+// En los nodos internos la clave i separa los hijos i e i + 1: todas las
+// claves del hijo i + 1 son mayores o iguales a ella y las del hijo i,
+// menores. Las hojas tienen los datos y un puntero a la hoja siguiente.
+// Cada nodo es dueño de sus claves: las de hasta LARGO_CLAVE_CORTA bytes se
+// guardan en cortas, dentro del nodo, y las más largas en memoria propia.
+struct nodo_b{
+	size_t cantidad;
+	bool hoja;
+	char *claves[MAX_CLAVES];
+	union {
+		nodo_b_t *hijos[MAX_CLAVES + 1];
+		struct {
+			void *datos[MAX_CLAVES];
+			nodo_b_t *siguiente;
+		};
+	};
+	char cortas[MAX_CLAVES][LARGO_CLAVE_CORTA + 1];
+};
+
+struct arbol_b{
+	nodo_b_t *raiz;
+	abb_comparar_clave_t cmp;
+	abb_destruir_dato_t destruir_dato;
+	size_t cantidad;
+};
+
+struct arbol_b_iter{
+	const nodo_b_t *hoja;
+	size_t posicion;
+	char *hasta;
+	abb_comparar_clave_t cmp;
+};
+
+static nodo_b_t *nodo_crear(bool hoja){
+	nodo_b_t *nodo = malloc(sizeof(nodo_b_t));
+	if (!nodo) return NULL;
+
+	nodo->cantidad = 0;
+	nodo->hoja = hoja;
+	if (hoja) nodo->siguiente = NULL;
+	return nodo;
+}
+
+static bool es_corta(const char *clave){
+	return strnlen(clave, LARGO_CLAVE_CORTA + 1) <= LARGO_CLAVE_CORTA;
+}
+
+static void liberar_clave(nodo_b_t *nodo, size_t i){
+	if (nodo->claves[i] != nodo->cortas[i]) free(nodo->claves[i]);
+}
+
+// Guarda en la posición i del nodo una copia de la clave.
+static bool copiar_clave(nodo_b_t *nodo, size_t i, const char *clave){
+	if (es_corta(clave)){
+		strcpy(nodo->cortas[i], clave);
+		nodo->claves[i] = nodo->cortas[i];
+		return true;
+	}
+	nodo->claves[i] = strdup(clave);
+	return nodo->claves[i] != NULL;
+}
+
+// Pasa la clave o de origen a la posición d de destino, sin copiarla si
+// es larga.
+static void mover_clave(nodo_b_t *destino, size_t d, nodo_b_t *origen, size_t o){
+	if (origen->claves[o] == origen->cortas[o]){
+		memmove(destino->cortas[d], origen->cortas[o], sizeof(destino->cortas[d]));
+		destino->claves[d] = destino->cortas[d];
+	} else destino->claves[d] = origen->claves[o];
+}
+
+// Pasa n claves de origen desde o a destino desde d. Pueden ser del mismo
+// nodo y superponerse.
+static void mover_claves(nodo_b_t *destino, size_t d, nodo_b_t *origen, size_t o, size_t n){
+	if (destino == origen && d > o){
+		for (size_t j = n; j > 0; j--) mover_clave(destino, d + j - 1, origen, o + j - 1);
+	} else {
+		for (size_t j = 0; j < n; j++) mover_clave(destino, d + j, origen, o + j);
+	}
+}
+
+// Búsqueda binaria: devuelve la primera posición cuya clave no es menor que
+// la buscada e indica si es igual.
+static size_t buscar_en_nodo(const arbol_b_t *arbol, const nodo_b_t *nodo, const char *clave, bool *igual){
+	size_t inicio = 0, fin = nodo->cantidad;
+	*igual = false;
+	while (inicio < fin){
+		size_t medio = inicio + (fin - inicio) / 2;
+		int comparacion = arbol->cmp(clave, nodo->claves[medio]);
+		if (comparacion == 0){
+			*igual = true;
+			return medio;
+		}
+		if (comparacion < 0) fin = medio;
+		else inicio = medio + 1;
+	}
+	return inicio;
+}
+
+// Devuelve el hijo de un nodo interno en el que tiene que estar la clave.
+static size_t hijo_para(const arbol_b_t *arbol, const nodo_b_t *nodo, const char *clave){
+	bool igual;
+	size_t i = buscar_en_nodo(arbol, nodo, clave, &igual);
+	return igual ? i + 1 : i;
+}
+
+// Baja hasta la hoja en la que tiene que estar la clave y devuelve su
+// posición en ella.
+static const nodo_b_t *buscar_hoja(const arbol_b_t *arbol, const char *clave, size_t *posicion, bool *igual){
+	const nodo_b_t *actual = arbol->raiz;
+	if (!actual) return NULL;
+	while (!actual->hoja) actual = actual->hijos[hijo_para(arbol, actual, clave)];
+	*posicion = buscar_en_nodo(arbol, actual, clave, igual);
+	return actual;
+}
+
+// Divide el hijo i del padre, que está lleno, en dos. Si el hijo es una hoja
+// la mitad derecha empieza con una clave que se copia al padre como
+// separadora; si es interno, la clave del medio sube al padre.
+// Pre: el padre no está lleno.
+static bool dividir(nodo_b_t *padre, size_t i){
+	nodo_b_t *hijo = padre->hijos[i];
+	nodo_b_t *nuevo = nodo_crear(hijo->hoja);
+	if (!nuevo) return false;
+
+	size_t mitad = MAX_CLAVES / 2;
+	mover_claves(padre, i + 1, padre, i, padre->cantidad - i);
+	memmove(&padre->hijos[i + 2], &padre->hijos[i + 1], (padre->cantidad - i) * sizeof(nodo_b_t *));
+
+	if (hijo->hoja){
+		if (!copiar_clave(padre, i, hijo->claves[mitad])){
+			mover_claves(padre, i, padre, i + 1, padre->cantidad - i);
+			memmove(&padre->hijos[i + 1], &padre->hijos[i + 2], (padre->cantidad - i) * sizeof(nodo_b_t *));
+			free(nuevo);
+			return false;
+		}
+		mover_claves(nuevo, 0, hijo, mitad, MAX_CLAVES - mitad);
+		memcpy(nuevo->datos, &hijo->datos[mitad], (MAX_CLAVES - mitad) * sizeof(void *));
+		nuevo->cantidad = MAX_CLAVES - mitad;
+		nuevo->siguiente = hijo->siguiente;
+		hijo->siguiente = nuevo;
+	} else {
+		mover_clave(padre, i, hijo, mitad);
+		mover_claves(nuevo, 0, hijo, mitad + 1, MAX_CLAVES - mitad - 1);
+		memcpy(nuevo->hijos, &hijo->hijos[mitad + 1], (MAX_CLAVES - mitad) * sizeof(nodo_b_t *));
+		nuevo->cantidad = MAX_CLAVES - mitad - 1;
+	}
+	hijo->cantidad = mitad;
+	padre->hijos[i + 1] = nuevo;
+	padre->cantidad++;
+	return true;
+}
+
+arbol_b_t *arbol_b_crear(abb_comparar_clave_t cmp, abb_destruir_dato_t destruir_dato){
+	arbol_b_t *arbol = malloc(sizeof(arbol_b_t));
+	if (!arbol) return NULL;
+
+	arbol->raiz = NULL;
+	arbol->cmp = cmp;
+	arbol->destruir_dato = destruir_dato;
+	arbol->cantidad = 0;
+	return arbol;
+}
+
+// Los nodos llenos se dividen al bajar, así siempre hay lugar en el padre
+// para la clave que sube y la inserción no necesita volver hacia arriba.
+bool arbol_b_guardar(arbol_b_t *arbol, const char *clave, void *dato){
+	if (!arbol->raiz){
+		arbol->raiz = nodo_crear(true);
+		if (!arbol->raiz) return false;
+	}
+	if (arbol->raiz->cantidad == MAX_CLAVES){
+		nodo_b_t *raiz = nodo_crear(false);
+		if (!raiz) return false;
+		raiz->hijos[0] = arbol->raiz;
+		if (!dividir(raiz, 0)){
+			free(raiz);
+			return false;
+		}
+		arbol->raiz = raiz;
+	}
+
+	nodo_b_t *actual = arbol->raiz;
+	while (!actual->hoja){
+		size_t i = hijo_para(arbol, actual, clave);
+		if (actual->hijos[i]->cantidad == MAX_CLAVES){
+			if (!dividir(actual, i)) return false;
+			if (arbol->cmp(clave, actual->claves[i]) >= 0) i++;
+		}
+		actual = actual->hijos[i];
+	}
+
+	bool igual;
+	size_t i = buscar_en_nodo(arbol, actual, clave, &igual);
+	if (igual){
+		if (arbol->destruir_dato) arbol->destruir_dato(actual->datos[i]);
+		actual->datos[i] = dato;
+		return true;
+	}
+
+	mover_claves(actual, i + 1, actual, i, actual->cantidad - i);
+	memmove(&actual->datos[i + 1], &actual->datos[i], (actual->cantidad - i) * sizeof(void *));
+	if (!copiar_clave(actual, i, clave)){
+		mover_claves(actual, i, actual, i + 1, actual->cantidad - i);
+		memmove(&actual->datos[i], &actual->datos[i + 1], (actual->cantidad - i) * sizeof(void *));
+		return false;
+	}
+	actual->datos[i] = dato;
+	actual->cantidad++;
+	arbol->cantidad++;
+	return true;
+}
+
+// Reemplaza la clave s del nodo por una copia de clave.
+static bool reemplazar_clave(nodo_b_t *nodo, size_t s, const char *clave){
+	char *larga = NULL;
+	if (!es_corta(clave) && !(larga = strdup(clave))) return false;
+	liberar_clave(nodo, s);
+	if (larga) nodo->claves[s] = larga;
+	else copiar_clave(nodo, s, clave);
+	return true;
+}
+
+// El hijo i del padre toma la última clave de su hermano izquierdo.
+static bool prestar_de_izquierda(nodo_b_t *padre, size_t i){
+	nodo_b_t *hijo = padre->hijos[i];
+	nodo_b_t *izq = padre->hijos[i - 1];
+	size_t ultima = izq->cantidad - 1;
+
+	if (hijo->hoja){
+		// La clave prestada pasa a ser la primera del hijo, así que es la
+		// nueva separadora. Se copia antes de mover nada por si falla.
+		if (!reemplazar_clave(padre, i - 1, izq->claves[ultima])) return false;
+		mover_claves(hijo, 1, hijo, 0, hijo->cantidad);
+		memmove(&hijo->datos[1], &hijo->datos[0], hijo->cantidad * sizeof(void *));
+		mover_clave(hijo, 0, izq, ultima);
+		hijo->datos[0] = izq->datos[ultima];
+	} else {
+		mover_claves(hijo, 1, hijo, 0, hijo->cantidad);
+		memmove(&hijo->hijos[1], &hijo->hijos[0], (hijo->cantidad + 1) * sizeof(nodo_b_t *));
+		mover_clave(hijo, 0, padre, i - 1);
+		hijo->hijos[0] = izq->hijos[ultima + 1];
+		mover_clave(padre, i - 1, izq, ultima);
+	}
+	izq->cantidad--;
+	hijo->cantidad++;
+	return true;
+}
+
+// El hijo i del padre toma la primera clave de su hermano derecho.
+static bool prestar_de_derecha(nodo_b_t *padre, size_t i){
+	nodo_b_t *hijo = padre->hijos[i];
+	nodo_b_t *der = padre->hijos[i + 1];
+
+	if (hijo->hoja){
+		if (!reemplazar_clave(padre, i, der->claves[1])) return false;
+		mover_clave(hijo, hijo->cantidad, der, 0);
+		hijo->datos[hijo->cantidad] = der->datos[0];
+		memmove(&der->datos[0], &der->datos[1], (der->cantidad - 1) * sizeof(void *));
+	} else {
+		mover_clave(hijo, hijo->cantidad, padre, i);
+		hijo->hijos[hijo->cantidad + 1] = der->hijos[0];
+		mover_clave(padre, i, der, 0);
+		memmove(&der->hijos[0], &der->hijos[1], der->cantidad * sizeof(nodo_b_t *));
+	}
+	mover_claves(der, 0, der, 1, der->cantidad - 1);
+	der->cantidad--;
+	hijo->cantidad++;
+	return true;
+}
+
+static bool cabe_fusion(const nodo_b_t *padre, size_t i){
+	const nodo_b_t *izq = padre->hijos[i];
+	const nodo_b_t *der = padre->hijos[i + 1];
+	return izq->cantidad + der->cantidad + (izq->hoja ? 0 : 1) <= MAX_CLAVES;
+}
+
+// Junta los hijos i e i + 1 del padre en el hijo i.
+static void fusionar(nodo_b_t *padre, size_t i){
+	nodo_b_t *izq = padre->hijos[i];
+	nodo_b_t *der = padre->hijos[i + 1];
+
+	if (izq->hoja){
+		mover_claves(izq, izq->cantidad, der, 0, der->cantidad);
+		memcpy(&izq->datos[izq->cantidad], der->datos, der->cantidad * sizeof(void *));
+		izq->cantidad += der->cantidad;
+		izq->siguiente = der->siguiente;
+		liberar_clave(padre, i);
+	} else {
+		mover_clave(izq, izq->cantidad, padre, i);
+		mover_claves(izq, izq->cantidad + 1, der, 0, der->cantidad);
+		memcpy(&izq->hijos[izq->cantidad + 1], der->hijos, (der->cantidad + 1) * sizeof(nodo_b_t *));
+		izq->cantidad += der->cantidad + 1;
+	}
+	mover_claves(padre, i, padre, i + 1, padre->cantidad - i - 1);
+	memmove(&padre->hijos[i + 1], &padre->hijos[i + 2], (padre->cantidad - i - 1) * sizeof(nodo_b_t *));
+	padre->cantidad--;
+	free(der);
+}
+
+static void _arbol_b_destruir(arbol_b_t *arbol, nodo_b_t *nodo){
+	for (size_t i = 0; i < nodo->cantidad; i++){
+		liberar_clave(nodo, i);
+		if (nodo->hoja && arbol->destruir_dato) arbol->destruir_dato(nodo->datos[i]);
+	}
+	if (!nodo->hoja){
+		for (size_t i = 0; i <= nodo->cantidad; i++) _arbol_b_destruir(arbol, nodo->hijos[i]);
+	}
+	free(nodo);
+}
+
+// Antes de bajar al hijo i se asegura de que tenga más del mínimo de
+// claves, prestándole una de un hermano o fusionándolo con él, así el
+// borrado nunca tiene que volver hacia arriba. Devuelve la posición en la
+// que quedó el hijo.
+static size_t reforzar(nodo_b_t *padre, size_t i){
+	bool hay_izq = i > 0, hay_der = i < padre->cantidad;
+	if (hay_izq && padre->hijos[i - 1]->cantidad > MIN_CLAVES && prestar_de_izquierda(padre, i)) return i;
+	if (hay_der && padre->hijos[i + 1]->cantidad > MIN_CLAVES && prestar_de_derecha(padre, i)) return i;
+	if (hay_der && cabe_fusion(padre, i)){
+		fusionar(padre, i);
+		return i;
+	}
+	if (hay_izq && cabe_fusion(padre, i - 1)){
+		fusionar(padre, i - 1);
+		return i - 1;
+	}
+	return i;
+}
+
+void *arbol_b_borrar(arbol_b_t *arbol, const char *clave){
+	nodo_b_t *actual = arbol->raiz;
+	if (!actual) return NULL;
+
+	while (!actual->hoja){
+		size_t i = hijo_para(arbol, actual, clave);
+		if (actual->hijos[i]->cantidad <= MIN_CLAVES) i = reforzar(actual, i);
+		nodo_b_t *hijo = actual->hijos[i];
+		// Solo la raíz puede quedarse sin claves, cuando se fusionan sus dos
+		// únicos hijos: el árbol pierde un nivel.
+		if (actual->cantidad == 0){
+			arbol->raiz = hijo;
+			free(actual);
+		}
+		actual = hijo;
+	}
+
+	bool igual;
+	size_t i = buscar_en_nodo(arbol, actual, clave, &igual);
+	if (!igual) return NULL;
+
+	void *dato = actual->datos[i];
+	liberar_clave(actual, i);
+	mover_claves(actual, i, actual, i + 1, actual->cantidad - i - 1);
+	memmove(&actual->datos[i], &actual->datos[i + 1], (actual->cantidad - i - 1) * sizeof(void *));
+	actual->cantidad--;
+	arbol->cantidad--;
+
+	if (arbol->cantidad == 0){
+		_arbol_b_destruir(arbol, arbol->raiz);
+		arbol->raiz = NULL;
+	}
+	return dato;
+}
+
+void *arbol_b_obtener(const arbol_b_t *arbol, const char *clave){
+	size_t i;
+	bool igual;
+	const nodo_b_t *hoja = buscar_hoja(arbol, clave, &i, &igual);
+	if (!hoja || !igual) return NULL;
+	return hoja->datos[i];
+}
+
+bool arbol_b_pertenece(const arbol_b_t *arbol, const char *clave){
+	size_t i;
+	bool igual;
+	const nodo_b_t *hoja = buscar_hoja(arbol, clave, &i, &igual);
+	return hoja && igual;
+}
+
+size_t arbol_b_cantidad(arbol_b_t *arbol){
+	return arbol->cantidad;
+}
+
+void arbol_b_destruir(arbol_b_t *arbol){
+	if (arbol->raiz) _arbol_b_destruir(arbol, arbol->raiz);
+	free(arbol);
+}
+
+// Deja la posición en la primera clave desde la dada, pasando a las hojas
+// siguientes si hace falta; la hoja queda en NULL si no hay más.
+static void normalizar(const nodo_b_t **hoja, size_t *posicion){
+	while (*hoja && *posicion >= (*hoja)->cantidad){
+		*hoja = (*hoja)->siguiente;
+		*posicion = 0;
+	}
+}
+
+// Devuelve la hoja y la posición de la primera clave mayor o igual a desde,
+// o de la primera del árbol si desde es NULL.
+static const nodo_b_t *primera_desde(const arbol_b_t *arbol, const char *desde, size_t *posicion){
+	const nodo_b_t *hoja = arbol->raiz;
+	*posicion = 0;
+	if (!hoja) return NULL;
+	if (desde){
+		bool igual;
+		hoja = buscar_hoja(arbol, desde, posicion, &igual);
+	} else {
+		while (!hoja->hoja) hoja = hoja->hijos[0];
+	}
+	normalizar(&hoja, posicion);
+	return hoja;
+}
+
+void arbol_b_in_order_rango(arbol_b_t *arbol, const char *desde, const char *hasta, bool visitar(const char *, void *, void *), void *extra){
+	size_t i;
+	for (const nodo_b_t *hoja = primera_desde(arbol, desde, &i); hoja; hoja = hoja->siguiente, i = 0){
+		for (; i < hoja->cantidad; i++){
+			if (hasta && arbol->cmp(hoja->claves[i], hasta) > 0) return;
+			if (!visitar(hoja->claves[i], hoja->datos[i], extra)) return;
+		}
+	}
+}
+
+void arbol_b_in_order(arbol_b_t *arbol, bool visitar(const char *, void *, void *), void *extra){
+	arbol_b_in_order_rango(arbol, NULL, NULL, visitar, extra);
+}
+
+arbol_b_iter_t *arbol_b_iter_in_crear_rango(const arbol_b_t *arbol, const char *desde, const char *hasta){
+	arbol_b_iter_t *iter = malloc(sizeof(arbol_b_iter_t));
+	if (!iter) return NULL;
+
+	iter->hasta = NULL;
+	if (hasta && !(iter->hasta = strdup(hasta))){
+		free(iter);
+		return NULL;
+	}
+	iter->cmp = arbol->cmp;
+	iter->hoja = primera_desde(arbol, desde, &iter->posicion);
+	return iter;
+}
+
+arbol_b_iter_t *arbol_b_iter_in_crear(const arbol_b_t *arbol){
+	return arbol_b_iter_in_crear_rango(arbol, NULL, NULL);
+}
+
+bool arbol_b_iter_in_al_final(const arbol_b_iter_t *iter){
+	if (!iter->hoja) return true;
+	if (!iter->hasta) return false;
+	return iter->cmp(iter->hoja->claves[iter->posicion], iter->hasta) > 0;
+}
+
+bool arbol_b_iter_in_avanzar(arbol_b_iter_t *iter){
+	if (arbol_b_iter_in_al_final(iter)) return false;
+	iter->posicion++;
+	normalizar(&iter->hoja, &iter->posicion);
+	return true;
+}
+
+const char *arbol_b_iter_in_ver_actual(const arbol_b_iter_t *iter){
+	if (arbol_b_iter_in_al_final(iter)) return NULL;
+	return iter->hoja->claves[iter->posicion];
+}
+
+void arbol_b_iter_in_destruir(arbol_b_iter_t *iter){
+	free(iter->hasta);
+	free(iter);
+}
@@ -0,0 +1,91 @@
+#ifndef ARBOL_B_H
+#define ARBOL_B_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "abb.h"
+
+// Diccionario ordenado con las mismas primitivas que abb.h, implementado
+// como un árbol B+. Cada nodo guarda decenas de claves contiguas, con las
+// cortas dentro del propio nodo, así una búsqueda recorre unos pocos nodos
+// en lugar de un nodo por nivel de un árbol binario. Los datos están solo
+// en las hojas, que están encadenadas en orden para recorrerlas sin volver
+// a bajar desde la raíz. El árbol se mantiene balanceado siempre.
+
+struct arbol_b;
+struct arbol_b_iter;
+
+typedef struct arbol_b arbol_b_t;
+typedef struct arbol_b_iter arbol_b_iter_t;
+
+
+// Crea el árbol
+arbol_b_t *arbol_b_crear(abb_comparar_clave_t cmp, abb_destruir_dato_t destruir_dato);
+
+// Guarda un elemento en el árbol. Si se pasa una clave que ya existe,
+// se reemplaza el dato. Si no logra guardarlo devuelve false
+// Pre: Se creó el árbol
+// Post: Se guardó el dato con su clave
+bool arbol_b_guardar(arbol_b_t *arbol, const char *clave, void *dato);
+
+// Borra un elemento del árbol. Si no encuentra la clave
+// devuelve NULL.
+// Pre: Se creó el árbol
+// Post: Se eliminó la clave
+void *arbol_b_borrar(arbol_b_t *arbol, const char *clave);
+
+// Busca un elemento en el árbol y devuelve su dato. Si
+// no encuentra la clave devuelve NULL.
+// Pre: Se creó el árbol
+void *arbol_b_obtener(const arbol_b_t *arbol, const char *clave);
+
+// Devuelve true si encuentra la clave en el árbol
+// y false si no la encuentra
+// Pre: Se creó el árbol
+bool arbol_b_pertenece(const arbol_b_t *arbol, const char *clave);
+
+// Devuelve la cantidad de elementos en el árbol
+// Pre: Se creó el árbol
+size_t arbol_b_cantidad(arbol_b_t *arbol);
+
+// Destruye el árbol
+// Pre: Se creó el árbol
+// Post: El árbol ha sido destruido
+void arbol_b_destruir(arbol_b_t *arbol);
+
+// Itera inorder sobre los elementos del árbol aplicándoles la función
+// visitar(), hasta que no haya más o hasta que devuelva false.
+// Pre: Se creó el árbol
+void arbol_b_in_order(arbol_b_t *arbol, bool visitar(const char *, void *, void *), void *extra);
+
+// Como arbol_b_in_order, pero solo sobre las claves entre desde y hasta,
+// ambas incluidas. Una cota NULL no limita ese extremo.
+// Pre: Se creó el árbol
+void arbol_b_in_order_rango(arbol_b_t *arbol, const char *desde, const char *hasta, bool visitar(const char *, void *, void *), void *extra);
+
+// Crea un iterador.
+// Post: devuelve un iterador en el primer elemento del árbol.
+arbol_b_iter_t *arbol_b_iter_in_crear(const arbol_b_t *arbol);
+
+// Crea un iterador sobre las claves entre desde y hasta, ambas incluidas.
+// Una cota NULL no limita ese extremo.
+// Post: devuelve un iterador en la primera clave mayor o igual a desde.
+arbol_b_iter_t *arbol_b_iter_in_crear_rango(const arbol_b_t *arbol, const char *desde, const char *hasta);
+
+// Avanza el iterador y devuelve true, si ya está al final, devuelve false.
+// Pre: El iterador fue creado
+bool arbol_b_iter_in_avanzar(arbol_b_iter_t *iter);
+
+// Devuelve la clave en la posición del iterador, o NULL si está al final.
+// Pre: El iterador fue creado
+const char *arbol_b_iter_in_ver_actual(const arbol_b_iter_t *iter);
+
+// Devuelve true si el iterador se encuentra al final, false si no es el caso.
+// Pre: El iterador fue creado
+bool arbol_b_iter_in_al_final(const arbol_b_iter_t *iter);
+
+// Destruye el iterador.
+// Pre: El iterador fue creado
+void arbol_b_iter_in_destruir(arbol_b_iter_t *iter);
+
+#endif  // ARBOL_B_H
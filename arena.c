@@ -0,0 +1,123 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#define TAM_BLOQUE 65536
+
+
+typedef struct bloque{
+	struct bloque *siguiente;
+	size_t usado;
+	size_t capacidad;
+	char datos[];
+} bloque_t;
+
+
+struct arena{
+	bloque_t *actual;
+	size_t usado;
+	size_t descartado;
+	size_t minimo_compactar;
+};
+
+
+arena_t *arena_crear(void){
+	arena_t *arena = malloc(sizeof(arena_t));
+	if (!arena) return NULL;
+
+	arena->actual = NULL;
+	arena->usado = 0;
+	arena->descartado = 0;
+	arena->minimo_compactar = 0;
+	return arena;
+}
+
+
+void arena_destruir(arena_t *arena){
+	bloque_t *actual = arena->actual;
+	while (actual){
+		bloque_t *siguiente = actual->siguiente;
+		free(actual);
+		actual = siguiente;
+	}
+	free(arena);
+}
+
+
+bloque_t *bloque_crear(size_t capacidad){
+	bloque_t *bloque = malloc(sizeof(bloque_t) + capacidad);
+	if (!bloque) return NULL;
+
+	bloque->siguiente = NULL;
+	bloque->usado = 0;
+	bloque->capacidad = capacidad;
+	return bloque;
+}
+
+
+char *arena_copiar(arena_t *arena, const char *clave, size_t largo){
+	size_t necesario = largo + 1;
+	bloque_t *bloque = arena->actual;
+
+	if (!bloque || bloque->capacidad - bloque->usado < necesario){
+		// Las claves muy largas van en un bloque propio, detrás del actual,
+		// para no desperdiciar lo que queda libre en él.
+		if (necesario > TAM_BLOQUE / 4){
+			bloque_t *propio = bloque_crear(necesario);
+			if (!propio) return NULL;
+			if (bloque){
+				propio->siguiente = bloque->siguiente;
+				bloque->siguiente = propio;
+			} else arena->actual = propio;
+			bloque = propio;
+		} else {
+			bloque = bloque_crear(TAM_BLOQUE);
+			if (!bloque) return NULL;
+			bloque->siguiente = arena->actual;
+			arena->actual = bloque;
+		}
+	}
+
+	char *copia = bloque->datos + bloque->usado;
+	memcpy(copia, clave, largo);
+	copia[largo] = '\0';
+	bloque->usado += necesario;
+	arena->usado += necesario;
+	return copia;
+}
+
+
+void arena_absorber(arena_t *destino, arena_t *origen){
+	if (origen->actual){
+		// Los bloques de origen van detrás del actual de destino, que es el
+		// único en el que se siguen copiando claves.
+		bloque_t *ultimo = origen->actual;
+		while (ultimo->siguiente) ultimo = ultimo->siguiente;
+		if (destino->actual){
+			ultimo->siguiente = destino->actual->siguiente;
+			destino->actual->siguiente = origen->actual;
+		} else destino->actual = origen->actual;
+	}
+	destino->usado += origen->usado;
+	destino->descartado += origen->descartado;
+	if (origen->minimo_compactar > destino->minimo_compactar) destino->minimo_compactar = origen->minimo_compactar;
+	free(origen);
+}
+
+
+void arena_descartar(arena_t *arena, size_t largo){
+	arena->descartado += largo + 1;
+}
+
+
+bool arena_conviene_compactar(const arena_t *arena){
+	if (arena->usado < arena->minimo_compactar) return false;
+	return arena->usado > TAM_BLOQUE && arena->descartado * 2 > arena->usado;
+}
+
+
+void arena_posponer_compactacion(arena_t *arena){
+	arena->minimo_compactar = arena->usado > SIZE_MAX / 2 ? SIZE_MAX : arena->usado * 2;
+}
@@ -0,0 +1,47 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct arena;
+typedef struct arena arena_t;
+
+// Crea una arena de claves. Las claves se copian una detrás de otra en
+// bloques grandes que pertenecen a la arena, en lugar de pedir memoria para
+// cada una.
+// Post: devuelve una nueva arena vacía.
+arena_t *arena_crear(void);
+
+// Destruye la arena, liberando todos sus bloques y por lo tanto todas las
+// claves copiadas en ella.
+// Pre: la arena fue creada.
+void arena_destruir(arena_t *arena);
+
+// Copia los largo bytes de clave en la arena agregándoles un '\0' final.
+// Devuelve la copia, o NULL si no pudo pedir memoria.
+// Pre: la arena fue creada.
+char *arena_copiar(arena_t *arena, const char *clave, size_t largo);
+
+// Registra que una clave de largo dado copiada en la arena ya no se usa. La
+// memoria no se reutiliza hasta que el dueño de la arena la compacte.
+// Pre: la arena fue creada.
+void arena_descartar(arena_t *arena, size_t largo);
+
+// Pasa todos los bloques de origen a destino y destruye origen. Las claves
+// copiadas en origen siguen siendo válidas y pasan a pertenecer a destino.
+// Pre: ambas arenas fueron creadas.
+void arena_absorber(arena_t *destino, arena_t *origen);
+
+// Devuelve true si más de la mitad de los bytes copiados en la arena ya
+// fueron descartados y conviene compactarla.
+// Pre: la arena fue creada.
+bool arena_conviene_compactar(const arena_t *arena);
+
+// Hace que arena_conviene_compactar devuelva false hasta que se haya
+// copiado en la arena tanto como ya tiene, para que quien no pudo
+// compactarla por falta de memoria no lo reintente en cada operación.
+// Pre: la arena fue creada.
+void arena_posponer_compactacion(arena_t *arena);
+
+#endif  // ARENA_H
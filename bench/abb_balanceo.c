@@ -0,0 +1,68 @@
+// Compara un ABB común con uno balanceado (abb_usar_balanceo) guardando y
+// buscando n claves, primero en orden creciente y después al azar. En orden,
+// el ABB común degenera en una lista y cada operación cuesta O(n), así que
+// con n grande esa parte tarda minutos: el tercer argumento la saltea.
+//
+// Desde la raíz del repositorio:
+//   gcc -std=gnu11 -O2 -I. bench/abb_balanceo.c abb.c -pthread -o abb_balanceo
+//   ./abb_balanceo [n] [n en orden]    (por defecto: 1000000 y 20000)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "abb.h"
+
+#define LARGO_CLAVE 32
+
+static double ahora(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static void medir(const char *nombre, char (*claves)[LARGO_CLAVE], size_t n, bool balanceado){
+	abb_t *arbol = abb_crear(strcmp, NULL);
+	if (!arbol) exit(1);
+	if (balanceado) abb_usar_balanceo(arbol);
+
+	double inicio = ahora();
+	for (size_t i = 0; i < n; i++) abb_guardar(arbol, claves[i], claves[i]);
+	double guardar = ahora() - inicio;
+
+	// Busca saltando de a 7919 posiciones, que pasa por todas las claves
+	// mientras n no sea múltiplo de 7919.
+	size_t encontrados = 0;
+	inicio = ahora();
+	for (size_t i = 0; i < n; i++) encontrados += abb_obtener(arbol, claves[(i * 7919) % n]) != NULL;
+	double obtener = ahora() - inicio;
+
+	inicio = ahora();
+	abb_destruir(arbol);
+	double destruir = ahora() - inicio;
+
+	printf("%-20s %-10s n=%-8zu guardar %8.1f ns  obtener %8.1f ns  destruir %6.1f ns  (%zu)\n", nombre, balanceado ? "AVL" : "sin AVL", n, guardar / (double)n * 1e9, obtener / (double)n * 1e9, destruir / (double)n * 1e9, encontrados);
+}
+
+int main(int argc, char *argv[]){
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	size_t n_orden = argc > 2 ? strtoul(argv[2], NULL, 10) : 20000;
+	size_t maximo = n > n_orden ? n : n_orden;
+	char (*claves)[LARGO_CLAVE] = malloc(maximo * LARGO_CLAVE);
+	if (!claves || maximo == 0) return 1;
+
+	for (size_t i = 0; i < maximo; i++) snprintf(claves[i], LARGO_CLAVE, "%010zu", i);
+	if (n_orden > 0){
+		medir("en orden", claves, n_orden, false);
+		medir("en orden", claves, n_orden, true);
+	}
+	medir("en orden", claves, n, true);
+
+	srand(1);
+	for (size_t i = 0; i < n; i++) snprintf(claves[i], LARGO_CLAVE, "%08x%07zu", (unsigned)rand(), i);
+	medir("al azar", claves, n, false);
+	medir("al azar", claves, n, true);
+
+	free(claves);
+	return 0;
+}
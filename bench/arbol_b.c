@@ -0,0 +1,77 @@
+// Compara el árbol B+ (arbol_b.h) con el ABB común y con el ABB balanceado
+// guardando n claves al azar de 15 bytes, que entran enteras en los nodos
+// del árbol B+, buscándolas todas y recorriéndolas en orden.
+//
+// Desde la raíz del repositorio:
+//   gcc -std=gnu11 -O2 -I. bench/arbol_b.c abb.c arbol_b.c -pthread -o arbol_b
+//   ./arbol_b [n]                  (por defecto: 1000000)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "abb.h"
+#include "arbol_b.h"
+
+#define LARGO_CLAVE 32
+
+static double ahora(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static bool contar(const char *clave, void *dato, void *extra){
+	(void)clave; (void)dato;
+	(*(size_t *)extra)++;
+	return true;
+}
+
+int main(int argc, char *argv[]){
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	char (*claves)[LARGO_CLAVE] = malloc(n * LARGO_CLAVE);
+	if (!claves || n == 0) return 1;
+	srand(1);
+	for (size_t i = 0; i < n; i++) snprintf(claves[i], LARGO_CLAVE, "%08x%07zu", (unsigned)rand(), i);
+
+	printf("n=%zu (ns por clave)\n", n);
+	for (int modo = 0; modo < 3; modo++){
+		abb_t *abb = NULL;
+		arbol_b_t *arbol_b = NULL;
+		if (modo < 2){
+			abb = abb_crear(strcmp, NULL);
+			if (abb && modo == 1) abb_usar_balanceo(abb);
+		} else {
+			arbol_b = arbol_b_crear(strcmp, NULL);
+		}
+		if (!abb && !arbol_b) return 1;
+
+		double inicio = ahora();
+		for (size_t i = 0; i < n; i++){
+			if (abb) abb_guardar(abb, claves[i], claves[i]);
+			else arbol_b_guardar(arbol_b, claves[i], claves[i]);
+		}
+		double guardar = ahora() - inicio;
+
+		// Saltar de a 7919 pasa por todas las claves si n no es múltiplo de 7919.
+		size_t encontrados = 0;
+		inicio = ahora();
+		for (size_t i = 0; i < n; i++){
+			const char *clave = claves[(i * 7919) % n];
+			encontrados += (abb ? abb_obtener(abb, clave) : arbol_b_obtener(arbol_b, clave)) != NULL;
+		}
+		double obtener = ahora() - inicio;
+
+		size_t recorridos = 0;
+		inicio = ahora();
+		if (abb) abb_in_order(abb, contar, &recorridos);
+		else arbol_b_in_order(arbol_b, contar, &recorridos);
+		double recorrer = ahora() - inicio;
+
+		printf("%-8s guardar %7.1f  obtener %7.1f  in order %5.1f  (%zu, %zu)\n", modo == 0 ? "abb" : modo == 1 ? "abb AVL" : "arbol_b", guardar / (double)n * 1e9, obtener / (double)n * 1e9, recorrer / (double)n * 1e9, encontrados, recorridos);
+		if (abb) abb_destruir(abb);
+		else arbol_b_destruir(arbol_b);
+	}
+	free(claves);
+	return 0;
+}
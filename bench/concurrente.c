@@ -0,0 +1,110 @@
+// Mide cuántas operaciones por segundo hacen entre varios hilos un
+// hash_concurrente_t y, como referencia, un hash_t protegido por un único
+// mutex. Cada hilo hace la misma cantidad de operaciones sobre claves al
+// azar de un conjunto fijo; un porcentaje son escrituras (mitad guardar,
+// mitad borrar) y el resto búsquedas. Prueba 1, 2, 4, ... hasta max_hilos.
+//
+// Desde la raíz del repositorio:
+//   gcc -std=gnu11 -O2 -I. bench/concurrente.c hash_concurrente.c hash.c arena.c -pthread -o concurrente
+//   ./concurrente [max_hilos] [% escrituras] [operaciones por hilo]
+//   (por defecto: 8, 10 y 1000000)
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "hash.h"
+#include "hash_concurrente.h"
+
+#define CLAVES 100000
+#define LARGO_CLAVE 16
+
+static char claves[CLAVES][LARGO_CLAVE];
+static size_t operaciones;
+static unsigned escrituras;
+
+typedef struct prueba{
+	hash_concurrente_t *concurrente;
+	hash_t *hash;
+	pthread_mutex_t mutex;
+} prueba_t;
+
+typedef struct hilo{
+	prueba_t *prueba;
+	unsigned semilla;
+	size_t encontrados;
+} hilo_t;
+
+static double ahora(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static void *trabajar(void *extra){
+	hilo_t *hilo = extra;
+	prueba_t *prueba = hilo->prueba;
+	for (size_t i = 0; i < operaciones; i++){
+		const char *clave = claves[(unsigned)rand_r(&hilo->semilla) % CLAVES];
+		unsigned tirada = (unsigned)rand_r(&hilo->semilla) % 200;
+		// Los datos son las propias claves, así que no hay nada que liberar.
+		if (prueba->concurrente){
+			if (tirada < escrituras) hash_concurrente_guardar(prueba->concurrente, clave, (void *)clave);
+			else if (tirada < 2 * escrituras) hash_concurrente_borrar(prueba->concurrente, clave);
+			else hilo->encontrados += hash_concurrente_obtener(prueba->concurrente, clave) != NULL;
+			continue;
+		}
+		pthread_mutex_lock(&prueba->mutex);
+		if (tirada < escrituras) hash_guardar(prueba->hash, clave, (void *)clave);
+		else if (tirada < 2 * escrituras) hash_borrar(prueba->hash, clave);
+		else hilo->encontrados += hash_obtener(prueba->hash, clave) != NULL;
+		pthread_mutex_unlock(&prueba->mutex);
+	}
+	return NULL;
+}
+
+static double medir(prueba_t *prueba, size_t cantidad_hilos){
+	pthread_t hilos[cantidad_hilos];
+	hilo_t datos[cantidad_hilos];
+	double inicio = ahora();
+	for (size_t i = 0; i < cantidad_hilos; i++){
+		datos[i] = (hilo_t){prueba, (unsigned)i + 1, 0};
+		pthread_create(&hilos[i], NULL, trabajar, &datos[i]);
+	}
+	for (size_t i = 0; i < cantidad_hilos; i++) pthread_join(hilos[i], NULL);
+	return (double)(operaciones * cantidad_hilos) / (ahora() - inicio) / 1e6;
+}
+
+int main(int argc, char *argv[]){
+	size_t max_hilos = argc > 1 ? strtoul(argv[1], NULL, 10) : 8;
+	unsigned porcentaje = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 10;
+	operaciones = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000000;
+	if (max_hilos == 0 || porcentaje > 100) return 1;
+	// Sobre 200: la mitad de las escrituras guarda y la otra mitad borra.
+	escrituras = porcentaje;
+	for (size_t i = 0; i < CLAVES; i++) snprintf(claves[i], LARGO_CLAVE, "c%zu", i);
+
+	printf("%u%% escrituras, %zu operaciones por hilo (millones de operaciones por segundo)\n", porcentaje, operaciones);
+	printf("%6s %14s %16s\n", "hilos", "hash + mutex", "hash_concurrente");
+	for (size_t cantidad_hilos = 1; cantidad_hilos <= max_hilos; cantidad_hilos *= 2){
+		double resultados[2];
+		for (int modo = 0; modo < 2; modo++){
+			prueba_t prueba = {0};
+			if (modo) prueba.concurrente = hash_concurrente_crear(NULL);
+			else prueba.hash = hash_crear(NULL);
+			pthread_mutex_init(&prueba.mutex, NULL);
+			if (!prueba.concurrente && !prueba.hash) return 1;
+			// Arranca con la mitad de las claves para que haya aciertos.
+			for (size_t i = 0; i < CLAVES; i += 2){
+				if (modo) hash_concurrente_guardar(prueba.concurrente, claves[i], claves[i]);
+				else hash_guardar(prueba.hash, claves[i], claves[i]);
+			}
+			resultados[modo] = medir(&prueba, cantidad_hilos);
+			if (modo) hash_concurrente_destruir(prueba.concurrente);
+			else hash_destruir(prueba.hash);
+			pthread_mutex_destroy(&prueba.mutex);
+		}
+		printf("%6zu %14.2f %16.2f\n", cantidad_hilos, resultados[0], resultados[1]);
+	}
+	return 0;
+}
@@ -0,0 +1,81 @@
+// Compara buscar n claves al azar de una en una con hash_obtener contra
+// buscarlas en lotes con hash_obtener_lote, sobre una tabla lo bastante
+// grande para no entrar en la caché. Hace lo mismo para guardar con
+// hash_guardar_lote sobre una tabla nueva.
+//
+// Desde la raíz del repositorio:
+//   gcc -std=gnu11 -O2 -I. bench/hash_lote.c hash.c arena.c -o hash_lote
+//   ./hash_lote [claves en la tabla] [búsquedas] [tamaño del lote]
+//   (por defecto: 8000000, 2000000 y 256; la tabla ocupa unos 450MB)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "hash.h"
+
+#define LARGO_CLAVE 32
+
+static double ahora(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]){
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 8000000;
+	size_t busquedas = argc > 2 ? strtoul(argv[2], NULL, 10) : 2000000;
+	size_t lote = argc > 3 ? strtoul(argv[3], NULL, 10) : 256;
+	if (n == 0 || lote == 0) return 1;
+	char (*claves)[LARGO_CLAVE] = malloc(n * LARGO_CLAVE);
+	const char **pedidas = malloc(busquedas * sizeof(char *));
+	void **datos = malloc(busquedas * sizeof(void *));
+	hash_t *uno = hash_crear(NULL);
+	hash_t *lotes = hash_crear(NULL);
+	if (!claves || !pedidas || !datos || !uno || !lotes) return 1;
+
+	srand(1);
+	for (size_t i = 0; i < n; i++) snprintf(claves[i], LARGO_CLAVE, "%08x%07zu", (unsigned)rand(), i);
+	for (size_t i = 0; i < busquedas; i++) pedidas[i] = claves[((size_t)rand() * RAND_MAX + (size_t)rand()) % n];
+
+	double inicio = ahora();
+	for (size_t i = 0; i < n; i++) hash_guardar(uno, claves[i], claves[i]);
+	double guardar_uno = ahora() - inicio;
+
+	// Los datos son las propias claves: se guardan en lotes del mismo tamaño.
+	inicio = ahora();
+	for (size_t i = 0; i < n; i += lote){
+		size_t cantidad = n - i < lote ? n - i : lote;
+		const char *pares[cantidad];
+		for (size_t j = 0; j < cantidad; j++) pares[j] = claves[i + j];
+		hash_guardar_lote(lotes, pares, (void **)pares, cantidad);
+	}
+	double guardar_lotes = ahora() - inicio;
+
+	// Se alternan las dos formas para que ninguna saque ventaja de lo que la
+	// otra dejó en la caché; cuenta la mejor de cada una.
+	size_t encontrados = 0;
+	double obtener_uno = 0, obtener_lotes = 0;
+	for (int vuelta = 0; vuelta < 3; vuelta++){
+		inicio = ahora();
+		for (size_t i = 0; i < busquedas; i += lote) hash_obtener_lote(uno, pedidas + i, busquedas - i < lote ? busquedas - i : lote, datos + i);
+		double tiempo = ahora() - inicio;
+		if (vuelta == 0 || tiempo < obtener_lotes) obtener_lotes = tiempo;
+		for (size_t i = 0; i < busquedas; i++) encontrados += datos[i] == pedidas[i];
+
+		inicio = ahora();
+		for (size_t i = 0; i < busquedas; i++) encontrados += hash_obtener(uno, pedidas[i]) == pedidas[i];
+		tiempo = ahora() - inicio;
+		if (vuelta == 0 || tiempo < obtener_uno) obtener_uno = tiempo;
+	}
+
+	printf("%zu claves, lotes de %zu (ns por clave)\n", n, lote);
+	printf("guardar  de a una %6.1f  en lotes %6.1f\n", guardar_uno / (double)n * 1e9, guardar_lotes / (double)n * 1e9);
+	printf("obtener  de a una %6.1f  en lotes %6.1f  (%zu de %zu encontradas)\n", obtener_uno / (double)busquedas * 1e9, obtener_lotes / (double)busquedas * 1e9, encontrados, 6 * busquedas);
+
+	hash_destruir(uno);
+	hash_destruir(lotes);
+	free(datos);
+	free(pedidas);
+	free(claves);
+	return 0;
+}
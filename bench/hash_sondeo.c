@@ -0,0 +1,77 @@
+// Mide guardar, obtener (claves presentes y ausentes) y borrar en un hash_t
+// con la tabla llena a distintos factores de carga, en nanosegundos por
+// operación. La tabla se crea con hash_crear_con_capacidad para que tenga
+// exactamente 2^k posiciones y se llena hasta el 50, 60 y 70% sin crecer.
+// Cargas mayores no se pueden medir: la tabla se duplica al llegar a
+// FACTOR_CARGA_MAX (70%).
+//
+// Desde la raíz del repositorio:
+//   gcc -std=gnu11 -O2 -I. bench/hash_sondeo.c hash.c arena.c -o hash_sondeo
+//   ./hash_sondeo [k]              (k por defecto: 20, o sea 1048576 posiciones)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "hash.h"
+
+#define LARGO_CLAVE 32
+#define CARGA_MAXIMA 70
+
+static double ahora(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static void informar(const char *nombre, double segundos, size_t n, size_t encontrados){
+	printf("  %-16s %8.1f ns/op  (%zu encontrados)\n", nombre, segundos / (double)n * 1e9, encontrados);
+}
+
+int main(int argc, char *argv[]){
+	size_t k = argc > 1 ? strtoul(argv[1], NULL, 10) : 20;
+	if (k < 4 || k > 30) return 1;
+	size_t capacidad = (size_t)1 << k;
+	// Con esta reserva la tabla tiene capacidad posiciones y guardar no la
+	// agranda mientras la carga quede por debajo de CARGA_MAXIMA.
+	size_t reserva = capacidad * CARGA_MAXIMA / 100;
+	char (*claves)[LARGO_CLAVE] = malloc(2 * reserva * LARGO_CLAVE);
+	if (!claves) return 1;
+
+	// Las primeras reserva claves pueden guardarse; las otras solo se buscan.
+	srand(1);
+	for (size_t i = 0; i < 2 * reserva; i++) snprintf(claves[i], LARGO_CLAVE, "%08x%07zu", (unsigned)rand(), i);
+
+	static const size_t cargas[] = {50, 60, 70};
+	for (size_t c = 0; c < sizeof(cargas) / sizeof(cargas[0]); c++){
+		// Al 70% se guarda una clave menos que la reserva, para quedar justo
+		// por debajo del punto en el que la tabla crece.
+		size_t n = capacidad * cargas[c] / 100;
+		if (n >= reserva) n = reserva - 1;
+		hash_t *hash = hash_crear_con_capacidad(NULL, reserva);
+		if (!hash) return 1;
+		printf("carga %zu%% (%zu claves en %zu posiciones)\n", cargas[c], n, capacidad);
+
+		double inicio = ahora();
+		for (size_t i = 0; i < n; i++) hash_guardar(hash, claves[i], claves[i]);
+		informar("guardar", ahora() - inicio, n, hash_cantidad(hash));
+
+		size_t encontrados = 0;
+		inicio = ahora();
+		for (size_t i = 0; i < n; i++) encontrados += hash_obtener(hash, claves[(i * 7919) % n]) != NULL;
+		informar("obtener (hay)", ahora() - inicio, n, encontrados);
+
+		encontrados = 0;
+		inicio = ahora();
+		for (size_t i = 0; i < n; i++) encontrados += hash_obtener(hash, claves[reserva + i]) != NULL;
+		informar("obtener (no hay)", ahora() - inicio, n, encontrados);
+
+		encontrados = 0;
+		inicio = ahora();
+		for (size_t i = 0; i < n; i++) encontrados += hash_borrar(hash, claves[i]) != NULL;
+		informar("borrar", ahora() - inicio, n, encontrados);
+
+		hash_destruir(hash);
+	}
+	free(claves);
+	return 0;
+}
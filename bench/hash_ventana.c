@@ -0,0 +1,76 @@
+// Mide un hash_t con muchas altas y bajas: guarda m claves nuevas y borra,
+// por cada una, la que entró ventana claves antes, así que la cantidad se
+// mantiene fija mientras la tabla sigue llenándose de borrados y
+// redimensionándose. Después, con la tabla fija en ventana claves, busca m
+// veces claves que están y m veces claves que ya se borraron. Sirve para
+// comparar el cálculo del grupo inicial y de cada paso del sondeo entre
+// versiones del hash. Con un tercer argumento
+// usa una función de hash propia cuyos 32 bits bajos son siempre cero, para
+// ver cómo reparte la tabla un hash con bits bajos malos.
+//
+// Desde la raíz del repositorio:
+//   gcc -std=gnu11 -O2 -I. bench/hash_ventana.c hash.c arena.c -o hash_ventana
+//   ./hash_ventana [m] [ventana] [debil]   (por defecto: 2000000 y 50000)
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "hash.h"
+
+#define LARGO_CLAVE 24
+
+static double ahora(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+// Solo mezcla los bits altos: en una tabla que toma el grupo inicial de los
+// bits bajos del hash, todas las claves empiezan en el mismo grupo.
+// Es FNV-1a corrido 32 bits, así no depende de wyhash y compila también
+// contra versiones del hash que no lo exportan.
+static size_t hash_debil(const char *clave, size_t largo, size_t semilla){
+	uint64_t h = 14695981039346656037ULL ^ semilla;
+	for (size_t i = 0; i < largo; i++) h = (h ^ (unsigned char)clave[i]) * 1099511628211ULL;
+	return (size_t)(h << 32);
+}
+
+int main(int argc, char *argv[]){
+	size_t m = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+	size_t ventana = argc > 2 ? strtoul(argv[2], NULL, 10) : 50000;
+	if (ventana == 0 || ventana >= m) return 1;
+	char (*claves)[LARGO_CLAVE] = malloc(m * LARGO_CLAVE);
+	hash_t *hash = argc > 3 ? hash_crear_con_funcion(NULL, hash_debil) : hash_crear(NULL);
+	if (!claves || !hash) return 1;
+	for (size_t i = 0; i < m; i++) snprintf(claves[i], LARGO_CLAVE, "v%014zu", i);
+
+	size_t borrados = 0;
+	double inicio = ahora();
+	for (size_t i = 0; i < m; i++){
+		hash_guardar(hash, claves[i], claves[i]);
+		if (i >= ventana) borrados += hash_borrar(hash, claves[i - ventana]) != NULL;
+	}
+	double segundos = ahora() - inicio;
+
+	printf("%zu altas, %zu bajas, ventana %zu: %.3f s (%.1f ns por alta y baja)\n", m, borrados, ventana, segundos, segundos / (double)m * 1e9);
+	printf("quedan %zu claves\n", hash_cantidad(hash));
+
+	// Las que están son las últimas ventana claves; las demás se borraron.
+	// Saltar de a 7919 las recorre todas mientras no sean múltiplo de 7919.
+	size_t encontrados = 0;
+	inicio = ahora();
+	for (size_t i = 0; i < m; i++) encontrados += hash_obtener(hash, claves[m - ventana + (i * 7919) % ventana]) != NULL;
+	segundos = ahora() - inicio;
+	printf("obtener (hay)    %.1f ns  (%zu de %zu encontradas)\n", segundos / (double)m * 1e9, encontrados, m);
+
+	encontrados = 0;
+	size_t ausentes = m - ventana;
+	inicio = ahora();
+	for (size_t i = 0; i < m; i++) encontrados += hash_obtener(hash, claves[(i * 7919) % ausentes]) != NULL;
+	segundos = ahora() - inicio;
+	printf("obtener (no hay) %.1f ns  (%zu de %zu encontradas)\n", segundos / (double)m * 1e9, encontrados, m);
+	hash_destruir(hash);
+	free(claves);
+	return 0;
+}
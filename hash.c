@@ -1,250 +1,1448 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include "hash.h"
+#include "arena.h"
 #include <stdio.h>
+#include <time.h>
 
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/random.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-#define TAM_INICIAL 10
-#define FACTOR_CARGA_MAX 70
-#define FACTOR_CARGA_MIN 25
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+// Las capacidades son siempre potencias de 2 (y múltiplos de TAM_GRUPO), así
+// la cantidad de grupos también lo es y el grupo inicial se obtiene con una
+// máscara en lugar de con el resto de una división.
+#define TAM_GRUPO 16
+#define TAM_INICIAL 16
 #define FACTOR_REDIMENSION 2
 
+// Política de redimensión, en porcentajes de la capacidad:
+// - Al guardar una clave nueva, si los campos ocupados más los borrados
+//   llegan a FACTOR_CARGA_MAX, la tabla se duplica; pero si los ocupados no
+//   llegan a la mitad de eso, se reconstruye con la misma capacidad para
+//   limpiar los borrados.
+// - Después de borrar, si los ocupados bajan de FACTOR_CARGA_MIN, la tabla
+//   se reduce a la mitad, quedando a menos del doble de FACTOR_CARGA_MIN.
+// - Nunca se reduce por debajo de TAM_INICIAL ni de la capacidad reservada.
+// Entre crecer (70%) y achicarse (20%) hay margen de sobra para que alternar
+// guardados y borrados cerca de un umbral no reconstruya la tabla una y otra
+// vez: después de crecer la carga queda en 35% y después de achicarse en 40%.
+#define FACTOR_CARGA_MAX 70
+#define FACTOR_CARGA_MIN 20
+#define PASOS_MIGRACION 8
+#define PASOS_REORGANIZACION 64
+#define LARGO_CLAVE_CORTA 15
+#define TAM_LOTE 32
+#define MAGIA_SNAPSHOT "HASHSNAP"
+#define VERSION_SNAPSHOT 2
+#define ORDEN_SNAPSHOT 0x01020304
+#define ALINEACION_SNAPSHOT 16
+
+
+// Cada posición de la tabla tiene un byte de control. Un campo ocupado
+// guarda en su byte los 7 bits bajos de su hash (0x00 a 0x7F), de modo que
+// los vacíos y borrados son los únicos con el bit alto prendido.
+#define CTRL_VACIO 0x80
+#define CTRL_BORRADO 0xFE
+#define ETIQUETA(h) ((uint8_t)((h) & 0x7F))
+#define MASCARA_GRUPOS(capacidad) ((capacidad) / TAM_GRUPO - 1)
+// Se pliegan los bits altos del hash sobre los bajos para que el grupo
+// dependa de todo el hash y no solo de sus bits bajos.
+#define GRUPO_INICIAL(h, mascara) ((size_t)(((uint64_t)(h) >> 7) ^ ((uint64_t)(h) >> 32)) & (mascara))
 
-typedef enum estado {
-	VACIO, OCUPADO, BORRADO
-} estado_t;
 
+// Con HASH_ESTADISTICAS cada hash lleva sus contadores; sin él estas macros
+// no generan código. Las búsquedas reciben el hash como const pero igual
+// actualizan sus contadores.
+#ifdef HASH_ESTADISTICAS
+#define CONTAR(hash, contador, n) (((hash_t *)(hash))->estadisticas.contador += (n))
+#define CONTAR_GRUPO(hash) (((hash_t *)(hash))->grupos_busqueda++)
+#define INICIAR_BUSQUEDA(hash) (((hash_t *)(hash))->grupos_busqueda = 0)
+#define REGISTRAR_BUSQUEDA(hash, encontrada) registrar_busqueda((hash_t *)(hash), encontrada)
+#define MEDIR_DESDE(inicio) double inicio = segundos_ahora()
+#define MEDIR_HASTA(hash, contador, inicio) CONTAR(hash, contador, segundos_ahora() - (inicio))
+#else
+#define CONTAR(hash, contador, n) ((void)0)
+#define CONTAR_GRUPO(hash) ((void)0)
+#define INICIAR_BUSQUEDA(hash) ((void)0)
+#define REGISTRAR_BUSQUEDA(hash, encontrada) ((void)0)
+#define MEDIR_DESDE(inicio) ((void)0)
+#define MEDIR_HASTA(hash, contador, inicio) ((void)0)
+#endif
+
+
+// Las claves de hasta LARGO_CLAVE_CORTA bytes se guardan dentro del campo;
+// las más largas en memoria propia o en la arena del hash.
+typedef union clave_campo{
+	char* larga;
+	char corta[LARGO_CLAVE_CORTA + 1];
+} clave_campo_t;
+
+
+// Un campo borrado queda como hueco en el arreglo de entradas, marcado con
+// este largo, hasta que se reorganizan las entradas.
+#define HUECO SIZE_MAX
 
 typedef struct campo{
-	char* clave;
+	clave_campo_t clave;
 	void* valor;
-	estado_t estado;
+	size_t hash;
+	size_t largo;
 } campo_t;
 
 
-struct hash{
+// La tabla es solo un índice: cada posición ocupada guarda la posición de su
+// campo en el arreglo de entradas del hash. Se divide en grupos de TAM_GRUPO
+// posiciones; los bytes de control de un grupo son contiguos, así que se
+// comparan todos juntos y solo se lee un campo cuando su etiqueta coincide
+// con la de la clave buscada.
+typedef struct tabla{
+	uint8_t* control;
+	uint32_t* indices;
 	size_t capacidad;
 	size_t cantidad;
-	hash_destruir_dato_t funcion_destruccion;
-	campo_t* tabla;
 	size_t carga;
+} tabla_t;
+
+
+// Un snapshot es una imagen del hash en un archivo que no contiene punteros,
+// solo desplazamientos desde su comienzo, así que puede proyectarse en
+// memoria en cualquier dirección. Tiene la cabecera, los bytes de control y
+// los índices de una tabla sin borrados, las entradas en orden de inserción
+// y por último las claves (con su '\0') y los datos serializados,
+// alineados a ALINEACION_SNAPSHOT.
+typedef struct cabecera_snapshot{
+	char magia[8];
+	uint32_t version;
+	uint32_t orden;
+	uint64_t semilla;
+	uint64_t cantidad;
+	uint64_t capacidad;
+	uint64_t control;
+	uint64_t indices;
+	uint64_t entradas;
+	uint64_t tamanio;
+} cabecera_snapshot_t;
+
+
+// dato y largo_dato son 0 si el snapshot no guarda datos.
+typedef struct entrada_snapshot{
+	uint64_t hash;
+	uint64_t largo;
+	uint64_t clave;
+	uint64_t dato;
+	uint64_t largo_dato;
+} entrada_snapshot_t;
+
+
+// Los campos se guardan en orden de inserción en el arreglo de entradas, sin
+// espacios libres salvo los huecos que dejan los borrados; recorrer el hash
+// cuesta entonces lo que sus elementos y no lo que la capacidad de la tabla.
+//
+// En modo incremental, al redimensionar la tabla anterior pasa a ser vieja y
+// sus índices se mudan a la nueva de a PASOS_MIGRACION grupos en cada guardado
+// o borrado. Mientras tanto las búsquedas miran las dos tablas.
+//
+// Cuando los huecos superan a los campos, o la arena tiene mucho espacio
+// descartado, se reorganizan las entradas: se corren hacia el principio
+// tapando los huecos, en orden y de a PASOS_REORGANIZACION por operación si
+// el modo es incremental. Las entradas en [escritura, lectura) ya se movieron
+// y son huecos. Si además se compacta la arena, las claves largas de las
+// entradas anteriores a fin_arena se copian a una arena nueva al moverse y
+// la vieja se libera al terminar.
+//
+// Un hash abierto de un snapshot tiene imagen apuntando al archivo en
+// memoria; su tabla apunta dentro de la imagen y sus entradas son las del
+// snapshot en lugar de campos.
+struct hash{
+	tabla_t tabla;
+	tabla_t vieja;
+	size_t migrados;
+	campo_t *entradas;
+	size_t usadas;
+	size_t capacidad_entradas;
+	size_t huecos;
+	bool reorganizando;
+	size_t lectura;
+	size_t escritura;
+	size_t fin_arena;
+	bool incremental;
+	size_t capacidad_minima;
+	arena_t *arena;
+	arena_t *arena_vieja;
+	size_t cantidad;
+	hash_destruir_dato_t funcion_destruccion;
+	hash_funcion_t funcion_hash;
+	size_t semilla;
+	const uint8_t *imagen;
+	size_t tam_imagen;
+	const entrada_snapshot_t *entradas_imagen;
+#ifdef HASH_ESTADISTICAS
+	hash_estadisticas_t estadisticas;
+	size_t grupos_busqueda;
+#endif
 };
 
 
 struct hash_iter{
 	const hash_t *hash;
-	campo_t *actual;
+	const char *actual;
 	size_t posicion_actual;
 };
 
 
-size_t FNVHash(const char* str, size_t length){
-	const size_t fnv_prime = 0x811C9DC5;
-	size_t hash = 0;
-	size_t i = 0;
+#ifdef HASH_ESTADISTICAS
+double segundos_ahora(void){
+	struct timespec ahora;
+	timespec_get(&ahora, TIME_UTC);
+	return (double)ahora.tv_sec + (double)ahora.tv_nsec / 1e9;
+}
+
 
-	for (i = 0; i < length; str++, i++){
-		hash *= fnv_prime;
-		hash ^= (size_t)(*str);
+// Anota en el histograma los grupos que recorrió la búsqueda que termina.
+void registrar_busqueda(hash_t *hash, bool encontrada){
+	size_t i = hash->grupos_busqueda ? hash->grupos_busqueda - 1 : 0;
+	if (i >= HASH_LARGO_HISTOGRAMA) i = HASH_LARGO_HISTOGRAMA - 1;
+	hash->estadisticas.sondeos[i]++;
+	if (encontrada) hash->estadisticas.busquedas_exitosas++;
+	else hash->estadisticas.busquedas_fallidas++;
+}
+#endif
+
+
+// Constantes de wyhash.
+#define WY_P0 0xa0761d6478bd642fULL
+#define WY_P1 0xe7037ed1a0b428dbULL
+#define WY_P2 0x8ebc6af09c88c6e3ULL
+#define WY_P3 0x589965cc75374cc3ULL
+
+
+// Reemplaza a y b por las mitades baja y alta de su producto de 128 bits.
+static inline void wy_multiplicar(uint64_t *a, uint64_t *b){
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t)*a * *b;
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+
+static inline uint64_t wy_mezclar(uint64_t a, uint64_t b){
+	wy_multiplicar(&a, &b);
+	return a ^ b;
+}
+
+
+static inline uint64_t wy_leer8(const uint8_t *p){
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+
+static inline uint64_t wy_leer4(const uint8_t *p){
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+
+// Función de hash por defecto. Lee la clave de a 8 bytes y la mezcla con
+// multiplicaciones de 128 bits; la semilla de cada tabla cambia por completo
+// los hashes, así que no se pueden elegir claves que colisionen de antemano.
+//link a función de hash: https://github.com/wangyi-fudan/wyhash
+size_t wyhash(const char *clave, size_t largo, size_t semilla){
+	const uint8_t *p = (const uint8_t *)clave;
+	uint64_t s = (uint64_t)semilla ^ wy_mezclar((uint64_t)semilla ^ WY_P0, WY_P1);
+	uint64_t a, b;
+
+	if (largo <= 16){
+		if (largo >= 4){
+			size_t medio = (largo >> 3) << 2;
+			a = (wy_leer4(p) << 32) | wy_leer4(p + medio);
+			b = (wy_leer4(p + largo - 4) << 32) | wy_leer4(p + largo - 4 - medio);
+		} else if (largo > 0){
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[largo >> 1] << 8) | p[largo - 1];
+			b = 0;
+		} else a = b = 0;
+	} else {
+		size_t i = largo;
+		if (i > 48){
+			uint64_t s1 = s, s2 = s;
+			do {
+				s = wy_mezclar(wy_leer8(p) ^ WY_P1, wy_leer8(p + 8) ^ s);
+				s1 = wy_mezclar(wy_leer8(p + 16) ^ WY_P2, wy_leer8(p + 24) ^ s1);
+				s2 = wy_mezclar(wy_leer8(p + 32) ^ WY_P3, wy_leer8(p + 40) ^ s2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			s ^= s1 ^ s2;
+		}
+		while (i > 16){
+			s = wy_mezclar(wy_leer8(p) ^ WY_P1, wy_leer8(p + 8) ^ s);
+			p += 16;
+			i -= 16;
+		}
+		a = wy_leer8(p + i - 16);
+		b = wy_leer8(p + i - 8);
 	}
 
-	return hash;
+	a ^= WY_P1;
+	b ^= s;
+	wy_multiplicar(&a, &b);
+	return (size_t)wy_mezclar(a ^ WY_P0 ^ largo, b ^ WY_P1);
 }
-//link a función de hash: https://meet.google.com/linkredirect?authuser=2&dest=https%3A%2F%2Fwww.programmingalgorithms.com%2Falgorithm%2Ffnv-hash%2Fc%2F
 
 
-hash_t *hash_crear(hash_destruir_dato_t destruir_dato){
+size_t hash_generar_semilla(const void *direccion){
+	static _Atomic uint64_t contador = 0;
+	uint64_t semilla = 0;
+
+#if defined(__linux__) || defined(__APPLE__)
+	if (getentropy(&semilla, sizeof(semilla)) == 0) return (size_t)semilla;
+#endif
+
+	semilla = wy_mezclar((uint64_t)time(NULL) ^ WY_P2, (uint64_t)clock() ^ WY_P3);
+	semilla = wy_mezclar(semilla ^ (uint64_t)(uintptr_t)direccion, (atomic_fetch_add(&contador, 1) + 1) ^ (uint64_t)(uintptr_t)&contador);
+	return (size_t)semilla;
+}
+
+
+// Devuelve una máscara con un bit prendido por cada byte de control del
+// grupo que es igual a valor.
+static inline uint32_t grupo_coincidencias(const uint8_t *grupo, uint8_t valor){
+#ifdef __SSE2__
+	__m128i bytes = _mm_loadu_si128((const __m128i *)grupo);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)valor)));
+#else
+	uint32_t mascara = 0;
+	for (size_t i = 0; i < TAM_GRUPO; i++){
+		if (grupo[i] == valor) mascara |= (uint32_t)1 << i;
+	}
+	return mascara;
+#endif
+}
+
+
+// Devuelve una máscara con las posiciones libres (vacías o borradas) del grupo.
+static inline uint32_t grupo_libres(const uint8_t *grupo){
+#ifdef __SSE2__
+	return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)grupo));
+#else
+	uint32_t mascara = 0;
+	for (size_t i = 0; i < TAM_GRUPO; i++){
+		if (grupo[i] & 0x80) mascara |= (uint32_t)1 << i;
+	}
+	return mascara;
+#endif
+}
+
+
+static inline size_t primer_bit(uint32_t mascara){
+	return (size_t)__builtin_ctz(mascara);
+}
+
+
+// Pide en un solo bloque los bytes de control y los índices de la tabla.
+bool tabla_crear(tabla_t *tabla, size_t capacidad){
+	uint8_t *bloque = malloc((sizeof(uint8_t) + sizeof(uint32_t)) * capacidad);
+	if (!bloque) return false;
+
+	memset(bloque, CTRL_VACIO, capacidad);
+	tabla->control = bloque;
+	tabla->indices = (uint32_t *)(bloque + capacidad);
+	tabla->capacidad = capacidad;
+	tabla->cantidad = 0;
+	tabla->carga = 0;
+	return true;
+}
+
+
+static inline const char *campo_clave(const campo_t *campo){
+	return campo->largo <= LARGO_CLAVE_CORTA ? campo->clave.corta : campo->clave.larga;
+}
+
+
+// Copia la clave agregándole el '\0' final, ya que puede no tenerlo.
+char *copiar_clave(const char *clave, size_t largo){
+	char *copia = malloc(largo + 1);
+	if (!copia) return NULL;
+	memcpy(copia, clave, largo);
+	copia[largo] = '\0';
+	return copia;
+}
+
+
+// Guarda en el campo una copia de la clave: dentro del campo si es corta,
+// en la arena si se recibe una o si no en memoria propia.
+bool campo_copiar_clave(arena_t *arena, campo_t *campo, const char *clave, size_t largo){
+	campo->largo = largo;
+	if (largo <= LARGO_CLAVE_CORTA){
+		memcpy(campo->clave.corta, clave, largo);
+		campo->clave.corta[largo] = '\0';
+		return true;
+	}
+	campo->clave.larga = arena ? arena_copiar(arena, clave, largo) : copiar_clave(clave, largo);
+	return campo->clave.larga != NULL;
+}
+
+
+void campo_liberar_clave(arena_t *arena, campo_t *campo){
+	if (campo->largo <= LARGO_CLAVE_CORTA) return;
+	if (arena) arena_descartar(arena, campo->largo);
+	else free(campo->clave.larga);
+}
+
+
+// Devuelve la menor capacidad válida en la que entran cantidad claves sin
+// llegar a FACTOR_CARGA_MAX, o 0 si cantidad supera lo que puede guardar un
+// hash: las entradas se indexan con 32 bits, y la cota sobre SIZE_MAX evita
+// que las cuentas de abajo desborden (la capacidad final no pasa del doble
+// de cantidad * 100 / FACTOR_CARGA_MAX).
+size_t capacidad_para(size_t cantidad){
+	if (cantidad > UINT32_MAX || cantidad > SIZE_MAX / (100 * FACTOR_REDIMENSION)) return 0;
+	size_t capacidad = TAM_INICIAL;
+	while (capacidad * FACTOR_CARGA_MAX < cantidad * 100) capacidad *= FACTOR_REDIMENSION;
+	return capacidad;
+}
+
+
+// Cantidad de entradas que llena una tabla de la capacidad dada antes de
+// tener que crecer.
+size_t entradas_para(size_t capacidad){
+	return capacidad * FACTOR_CARGA_MAX / 100;
+}
+
+
+hash_t *crear_hash(hash_destruir_dato_t destruir_dato, hash_funcion_t funcion_hash, size_t capacidad){
 	hash_t *hash = malloc(sizeof(hash_t));
 	if (!hash) return NULL;
 
 	hash->cantidad = 0;
-	hash->capacidad = TAM_INICIAL;
 	hash->funcion_destruccion = destruir_dato;
-	hash->carga = 0;
-
-	hash->tabla = malloc(sizeof(campo_t) * hash->capacidad);
-	if (!hash->tabla) return NULL;
+	hash->funcion_hash = funcion_hash;
+	hash->semilla = hash_generar_semilla(hash);
+	hash->vieja.capacidad = 0;
+	hash->migrados = 0;
+	hash->usadas = 0;
+	hash->huecos = 0;
+	hash->reorganizando = false;
+	hash->lectura = 0;
+	hash->escritura = 0;
+	hash->fin_arena = 0;
+	hash->incremental = false;
+	hash->capacidad_minima = capacidad;
+	hash->arena = NULL;
+	hash->arena_vieja = NULL;
+	hash->imagen = NULL;
+#ifdef HASH_ESTADISTICAS
+	memset(&hash->estadisticas, 0, sizeof(hash->estadisticas));
+#endif
 
-	for (size_t i = 0; i < hash->capacidad; i++) hash->tabla[i].estado = VACIO;
+	hash->capacidad_entradas = entradas_para(capacidad);
+	hash->entradas = malloc(sizeof(campo_t) * hash->capacidad_entradas);
+	if (!hash->entradas){
+		free(hash);
+		return NULL;
+	}
+	if (!tabla_crear(&hash->tabla, capacidad)){
+		free(hash->entradas);
+		free(hash);
+		return NULL;
+	}
 	return hash;
 }
 
 
+hash_t *hash_crear(hash_destruir_dato_t destruir_dato){
+	return crear_hash(destruir_dato, wyhash, TAM_INICIAL);
+}
+
+
+hash_t *hash_crear_con_funcion(hash_destruir_dato_t destruir_dato, hash_funcion_t funcion_hash){
+	return crear_hash(destruir_dato, funcion_hash, TAM_INICIAL);
+}
+
+
+hash_t *hash_crear_con_capacidad(hash_destruir_dato_t destruir_dato, size_t cantidad){
+	size_t capacidad = capacidad_para(cantidad);
+	if (capacidad == 0) return NULL;
+	return crear_hash(destruir_dato, wyhash, capacidad);
+}
+
+
+// Devuelve la arena en la que está la clave larga de la entrada en la
+// posición dada, o NULL si el hash no usa arena.
+arena_t *arena_de(const hash_t *hash, size_t posicion){
+	if (hash->arena_vieja && posicion >= hash->lectura && posicion < hash->fin_arena) return hash->arena_vieja;
+	return hash->arena;
+}
+
+
+#if defined(__linux__) || defined(__APPLE__)
+// Proyecta el archivo en memoria de solo lectura, compartida con los demás
+// procesos que lo proyecten.
+const uint8_t *cargar_imagen(const char *ruta, size_t *tamanio){
+	int fd = open(ruta, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	void *imagen = MAP_FAILED;
+	struct stat datos;
+	if (fstat(fd, &datos) == 0 && datos.st_size > 0){
+		*tamanio = (size_t)datos.st_size;
+		imagen = mmap(NULL, *tamanio, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	return imagen == MAP_FAILED ? NULL : imagen;
+}
+
+
+void descargar_imagen(const uint8_t *imagen, size_t tamanio){
+	munmap((void *)imagen, tamanio);
+}
+#else
+// Sin mmap se lee el archivo entero a memoria propia.
+const uint8_t *cargar_imagen(const char *ruta, size_t *tamanio){
+	FILE *archivo = fopen(ruta, "rb");
+	if (!archivo) return NULL;
+
+	uint8_t *imagen = NULL;
+	long largo = fseek(archivo, 0, SEEK_END) == 0 ? ftell(archivo) : -1;
+	if (largo > 0 && fseek(archivo, 0, SEEK_SET) == 0) imagen = malloc((size_t)largo);
+	if (imagen && fread(imagen, 1, (size_t)largo, archivo) != (size_t)largo){
+		free(imagen);
+		imagen = NULL;
+	}
+	fclose(archivo);
+	*tamanio = (size_t)largo;
+	return imagen;
+}
+
+
+void descargar_imagen(const uint8_t *imagen, size_t tamanio){
+	(void)tamanio;
+	free((void *)imagen);
+}
+#endif
+
+
 void hash_destruir(hash_t *hash){
-	campo_t *actual;
-	for (size_t i = 0; i < hash->capacidad; i++){
-		actual = &hash->tabla[i];
-		if (actual->estado == OCUPADO){
-			free(actual->clave);
-			if (hash->funcion_destruccion) hash->funcion_destruccion(actual->valor);
+	if (hash->imagen){
+		descargar_imagen(hash->imagen, hash->tam_imagen);
+		free(hash);
+		return;
+	}
+	for (size_t i = 0; i < hash->usadas; i++){
+		campo_t *campo = &hash->entradas[i];
+		if (campo->largo == HUECO) continue;
+		campo_liberar_clave(arena_de(hash, i), campo);
+		if (hash->funcion_destruccion) hash->funcion_destruccion(campo->valor);
+	}
+	free(hash->entradas);
+	free(hash->tabla.control);
+	if (hash->vieja.capacidad) free(hash->vieja.control);
+	if (hash->arena) arena_destruir(hash->arena);
+	if (hash->arena_vieja) arena_destruir(hash->arena_vieja);
+	free(hash);
+}
+
+
+bool hash_usar_arena(hash_t *hash){
+	if (hash->imagen) return false;
+	if (hash->arena) return true;
+	hash->arena = arena_crear();
+	return hash->arena != NULL;
+}
+
+
+// Agranda el arreglo de entradas para que entren al menos cantidad.
+bool entradas_reservar(hash_t *hash, size_t cantidad){
+	if (cantidad <= hash->capacidad_entradas) return true;
+	if (cantidad > UINT32_MAX) return false;
+
+	campo_t *entradas = realloc(hash->entradas, sizeof(campo_t) * cantidad);
+	if (!entradas) return false;
+	hash->entradas = entradas;
+	hash->capacidad_entradas = cantidad;
+	return true;
+}
+
+
+// Devuelve la primera posición libre en la secuencia de sondeo de h.
+size_t buscar_libre(const tabla_t *tabla, size_t h){
+	size_t mascara = MASCARA_GRUPOS(tabla->capacidad);
+	size_t g = GRUPO_INICIAL(h, mascara);
+	uint32_t libres;
+
+	while (!(libres = grupo_libres(&tabla->control[g * TAM_GRUPO]))) g = (g + 1) & mascara;
+	return g * TAM_GRUPO + primer_bit(libres);
+}
+
+
+// Agrega a la tabla el índice de una entrada cuyo hash es h, sin volver a
+// hashear ni comparar la clave. Devuelve su posición.
+size_t tabla_agregar(tabla_t *tabla, size_t h, uint32_t indice){
+	size_t n = buscar_libre(tabla, h);
+	if (tabla->control[n] == CTRL_VACIO) tabla->carga++;
+	tabla->control[n] = ETIQUETA(h);
+	tabla->indices[n] = indice;
+	tabla->cantidad++;
+	return n;
+}
+
+
+// Saca de la tabla el índice en la posición n, sin tocar su entrada.
+void tabla_quitar(tabla_t *tabla, size_t n){
+	// Si el grupo todavía tiene un campo vacío, nunca estuvo lleno y ninguna
+	// secuencia de sondeo pasó de largo por él: se lo puede vaciar sin
+	// dejar una marca de borrado.
+	if (grupo_coincidencias(&tabla->control[n - n % TAM_GRUPO], CTRL_VACIO)){
+		tabla->control[n] = CTRL_VACIO;
+		tabla->carga--;
+	} else tabla->control[n] = CTRL_BORRADO;
+	tabla->cantidad--;
+}
+
+
+// Devuelve la posición de la tabla que apunta a la entrada indice, cuyo
+// hash es h, o la capacidad de la tabla si no está en ella.
+size_t tabla_ubicar(const tabla_t *tabla, size_t h, uint32_t indice){
+	size_t mascara = MASCARA_GRUPOS(tabla->capacidad);
+	size_t g = GRUPO_INICIAL(h, mascara);
+
+	while (true){
+		const uint8_t *grupo = &tabla->control[g * TAM_GRUPO];
+		uint32_t candidatos = grupo_coincidencias(grupo, ETIQUETA(h));
+		while (candidatos){
+			size_t n = g * TAM_GRUPO + primer_bit(candidatos);
+			if (tabla->indices[n] == indice) return n;
+			candidatos &= candidatos - 1;
 		}
+		if (grupo_coincidencias(grupo, CTRL_VACIO)) return tabla->capacidad;
+		g = (g + 1) & mascara;
 	}
+}
 
-	free(hash->tabla);
-	free(hash);
+
+bool migrando(const hash_t *hash){
+	return hash->vieja.capacidad != 0;
 }
 
 
-bool redimensionar(hash_t *hash, size_t capacidad_nueva){
-	campo_t* tabla_nueva = malloc(sizeof(campo_t) * capacidad_nueva);
-	if (!tabla_nueva) return false;
+// Muda a la tabla actual hasta grupos grupos de la tabla vieja. Cuando la
+// vieja queda vacía la libera y termina la migración.
+void migrar(hash_t *hash, size_t grupos){
+	MEDIR_DESDE(inicio);
+	tabla_t *vieja = &hash->vieja;
+	size_t total = vieja->capacidad / TAM_GRUPO;
 
-	for (size_t i = 0; i < capacidad_nueva; i++) tabla_nueva[i].estado = VACIO;
-	campo_t *actual;
-	campo_t *tabla_vieja = hash->tabla;
-	hash->tabla = tabla_nueva;
-	hash->cantidad = 0;
-	size_t capacidad_vieja = hash->capacidad;
-	hash->capacidad = capacidad_nueva;
-
-	for (size_t i = 0; i < capacidad_vieja; i++){
-		actual = &tabla_vieja[i];
-		if (actual->estado == OCUPADO){
-			hash_guardar(hash, actual->clave, actual->valor);
-			free(actual->clave);
+	for (; grupos > 0 && hash->migrados < total && vieja->cantidad > 0; grupos--, hash->migrados++){
+		size_t primera = hash->migrados * TAM_GRUPO;
+		for (size_t i = primera; i < primera + TAM_GRUPO; i++){
+			if (vieja->control[i] & 0x80) continue;
+			uint32_t indice = vieja->indices[i];
+			tabla_agregar(&hash->tabla, hash->entradas[indice].hash, indice);
+			// Se marca como borrado y no como vacío para no cortar las
+			// secuencias de sondeo de los campos que todavía no se mudaron.
+			vieja->control[i] = CTRL_BORRADO;
+			vieja->cantidad--;
 		}
 	}
 
-	hash->carga = hash->cantidad;
-	free(tabla_vieja);
+	if (vieja->cantidad == 0){
+		free(vieja->control);
+		vieja->capacidad = 0;
+		hash->migrados = 0;
+	}
+	MEDIR_HASTA(hash, segundos_redimension, inicio);
+}
+
+
+bool redimensionar(hash_t *hash, size_t capacidad_nueva){
+	if (migrando(hash)) migrar(hash, SIZE_MAX);
+
+	tabla_t nueva;
+	if (!tabla_crear(&nueva, capacidad_nueva)) return false;
+
+	hash->vieja = hash->tabla;
+	hash->tabla = nueva;
+	hash->migrados = 0;
+	CONTAR(hash, redimensiones, 1);
+	migrar(hash, hash->incremental ? PASOS_MIGRACION : SIZE_MAX);
 	return true;
 }
 
 
-bool hash_guardar(hash_t *hash, const char *clave, void *dato){
-	if (((hash->carga * 100) / hash->capacidad) >= FACTOR_CARGA_MAX){
-		if (!redimensionar(hash, hash->capacidad * FACTOR_REDIMENSION)) return false;
+// Cambia el índice que apunta a la entrada desde por uno que apunta a hasta,
+// en la tabla actual o en la vieja.
+void reapuntar(hash_t *hash, size_t desde, size_t hasta){
+	size_t h = hash->entradas[desde].hash;
+	tabla_t *tabla = &hash->tabla;
+	size_t n = tabla_ubicar(tabla, h, (uint32_t)desde);
+	if (n == tabla->capacidad){
+		tabla = &hash->vieja;
+		n = tabla_ubicar(tabla, h, (uint32_t)desde);
+	}
+	tabla->indices[n] = (uint32_t)hasta;
+}
+
+
+bool conviene_reorganizar(const hash_t *hash){
+	if (hash->huecos >= TAM_INICIAL && hash->huecos > hash->cantidad) return true;
+	return hash->arena && arena_conviene_compactar(hash->arena);
+}
+
+
+void comenzar_reorganizacion(hash_t *hash){
+	if (hash->arena && arena_conviene_compactar(hash->arena)){
+		arena_t *arena_nueva = arena_crear();
+		if (arena_nueva){
+			hash->arena_vieja = hash->arena;
+			hash->arena = arena_nueva;
+			hash->fin_arena = hash->usadas;
+		} else arena_posponer_compactacion(hash->arena);
+	}
+	hash->lectura = 0;
+	hash->escritura = 0;
+	hash->reorganizando = true;
+	CONTAR(hash, reorganizaciones, 1);
+}
+
+
+// Mueve hasta pasos entradas hacia el principio del arreglo, tapando los
+// huecos. Cuando llega al final achica el arreglo si sobra mucho lugar,
+// libera la arena vieja y termina la reorganización.
+void reorganizar(hash_t *hash, size_t pasos){
+	MEDIR_DESDE(inicio);
+	for (; pasos > 0 && hash->lectura < hash->usadas; pasos--, hash->lectura++){
+		campo_t *campo = &hash->entradas[hash->lectura];
+		if (campo->largo == HUECO){
+			hash->huecos--;
+			continue;
+		}
+		if (hash->arena_vieja && hash->lectura < hash->fin_arena && campo->largo > LARGO_CLAVE_CORTA){
+			char *copia = arena_copiar(hash->arena, campo->clave.larga, campo->largo);
+			if (copia){
+				campo->clave.larga = copia;
+				CONTAR(hash, bytes_claves, campo->largo + 1);
+			} else {
+				// Sin memoria para compactar: la arena vieja pasa a ser
+				// parte de la nueva y las claves restantes quedan donde están.
+				// Como la unión sigue teniendo todo lo descartado, se pospone
+				// el próximo intento; si no, cada borrado volvería a empezar
+				// una reorganización completa.
+				arena_absorber(hash->arena, hash->arena_vieja);
+				hash->arena_vieja = NULL;
+				arena_posponer_compactacion(hash->arena);
+			}
+		}
+		if (hash->lectura != hash->escritura){
+			reapuntar(hash, hash->lectura, hash->escritura);
+			hash->entradas[hash->escritura] = *campo;
+			campo->largo = HUECO;
+		}
+		hash->escritura++;
+	}
+	if (hash->lectura < hash->usadas){
+		MEDIR_HASTA(hash, segundos_reorganizacion, inicio);
+		return;
 	}
 
-	size_t n = FNVHash(clave, strlen(clave)) % hash->capacidad;
-	campo_t *actual = &hash->tabla[n];
+	hash->usadas = hash->escritura;
+	hash->reorganizando = false;
+	if (hash->arena_vieja) arena_destruir(hash->arena_vieja);
+	hash->arena_vieja = NULL;
 
-	while (actual->estado != VACIO){
-		if (actual->estado == OCUPADO && !strcmp(actual->clave,clave)){
-			if (hash->funcion_destruccion) hash->funcion_destruccion(actual->valor);
-			actual->valor = dato;
-			return true;
+	// Si no se puede achicar el arreglo simplemente queda más grande.
+	size_t minimo = entradas_para(hash->capacidad_minima);
+	if (hash->capacidad_entradas / 2 >= minimo && hash->usadas * 4 < hash->capacidad_entradas){
+		size_t capacidad = hash->usadas * 2 > minimo ? hash->usadas * 2 : minimo;
+		campo_t *entradas = realloc(hash->entradas, sizeof(campo_t) * capacidad);
+		if (entradas){
+			hash->entradas = entradas;
+			hash->capacidad_entradas = capacidad;
 		}
-		n++;
-		if (n == hash->capacidad) n = 0;
-		actual = &hash->tabla[n];
 	}
+	MEDIR_HASTA(hash, segundos_reorganizacion, inicio);
+}
 
-	actual->clave = strdup(clave);
-	if (!actual->clave) return false;
 
-	actual->valor = dato;
-	actual->estado = OCUPADO;
-	hash->cantidad++;
-	hash->carga++;
-	return true;
+// Avanza la migración de la tabla y la reorganización de las entradas que
+// estén en curso.
+void avanzar_pendientes(hash_t *hash){
+	if (migrando(hash)) migrar(hash, PASOS_MIGRACION);
+	if (hash->reorganizando) reorganizar(hash, PASOS_REORGANIZACION);
+}
+
+
+bool hash_reservar(hash_t *hash, size_t cantidad){
+	if (hash->imagen) return false;
+	size_t capacidad = capacidad_para(cantidad);
+	if (capacidad == 0) return false;
+	if (capacidad > hash->capacidad_minima) hash->capacidad_minima = capacidad;
+	size_t nuevas = cantidad > hash->cantidad ? cantidad - hash->cantidad : 0;
+	if (!entradas_reservar(hash, hash->usadas + nuevas)) return false;
+	if (capacidad <= hash->tabla.capacidad) return true;
+	return redimensionar(hash, capacidad);
 }
 
 
-campo_t *buscar_campo(const hash_t *hash, const char *clave){
-	size_t n = FNVHash(clave, strlen(clave)) % hash->capacidad;
-	campo_t *actual = &hash->tabla[n];
+void hash_redimension_incremental(hash_t *hash, bool incremental){
+	if (!incremental && migrando(hash)) migrar(hash, SIZE_MAX);
+	if (!incremental && hash->reorganizando) reorganizar(hash, SIZE_MAX);
+	hash->incremental = incremental;
+}
 
-	while (actual->estado != VACIO){
-		if (actual->estado == OCUPADO && !strcmp(actual->clave,clave)) break;
-		n++;
-		if (n == hash->capacidad) n = 0;
-		actual = &hash->tabla[n];
+
+// Recorre la secuencia de sondeo de la clave grupo por grupo. Devuelve la
+// posición del índice de la clave, o la capacidad de la tabla si no está.
+size_t buscar_posicion(const hash_t *hash, const tabla_t *tabla, const hash_clave_t *clave){
+	size_t h = clave->hash;
+	size_t mascara = MASCARA_GRUPOS(tabla->capacidad);
+	size_t g = GRUPO_INICIAL(h, mascara);
+	uint8_t etiqueta = ETIQUETA(h);
+
+	while (true){
+		CONTAR_GRUPO(hash);
+		const uint8_t *grupo = &tabla->control[g * TAM_GRUPO];
+		uint32_t candidatos = grupo_coincidencias(grupo, etiqueta);
+		while (candidatos){
+			size_t n = g * TAM_GRUPO + primer_bit(candidatos);
+			const campo_t *actual = &hash->entradas[tabla->indices[n]];
+			if (actual->hash == h && actual->largo == clave->largo){
+				CONTAR(hash, comparaciones, 1);
+				if (!memcmp(campo_clave(actual), clave->clave, clave->largo)) return n;
+			}
+			candidatos &= candidatos - 1;
+		}
+		if (grupo_coincidencias(grupo, CTRL_VACIO)) return tabla->capacidad;
+		g = (g + 1) & mascara;
 	}
+}
+
 
-	if (actual->estado == VACIO) return NULL;
-	return actual;
+// Busca la clave en la tabla actual y, si se está migrando, en la vieja.
+// Devuelve su campo y la tabla y posición de su índice, o NULL si no está.
+campo_t *buscar_campo(const hash_t *hash, const hash_clave_t *clave, tabla_t **tabla, size_t *posicion){
+	INICIAR_BUSQUEDA(hash);
+	tabla_t *actual = (tabla_t *)&hash->tabla;
+	size_t n = buscar_posicion(hash, actual, clave);
+	if (n == actual->capacidad && migrando(hash) && hash->vieja.cantidad != 0){
+		actual = (tabla_t *)&hash->vieja;
+		n = buscar_posicion(hash, actual, clave);
+	}
+	REGISTRAR_BUSQUEDA(hash, n != actual->capacidad);
+	if (n == actual->capacidad) return NULL;
+	if (tabla) *tabla = actual;
+	if (posicion) *posicion = n;
+	return &hash->entradas[actual->indices[n]];
 }
 
 
-void *hash_borrar(hash_t *hash, const char *clave){
-	if (((hash->carga * 100) / hash->capacidad) <= FACTOR_CARGA_MIN){
-		if (!redimensionar(hash, hash->capacidad / FACTOR_REDIMENSION)) return false;
+static inline const char *imagen_clave(const hash_t *hash, const entrada_snapshot_t *entrada){
+	return (const char *)hash->imagen + entrada->clave;
+}
+
+
+void *imagen_dato(const hash_t *hash, const entrada_snapshot_t *entrada){
+	if (!entrada->dato) return NULL;
+	return (void *)(hash->imagen + entrada->dato);
+}
+
+
+// Como buscar_posicion, para un hash abierto de un snapshot. Devuelve la
+// entrada con la clave, o NULL si no está.
+const entrada_snapshot_t *imagen_buscar(const hash_t *hash, const hash_clave_t *clave){
+	const tabla_t *tabla = &hash->tabla;
+	size_t h = clave->hash;
+	size_t mascara = MASCARA_GRUPOS(tabla->capacidad);
+	size_t g = GRUPO_INICIAL(h, mascara);
+	uint8_t etiqueta = ETIQUETA(h);
+	INICIAR_BUSQUEDA(hash);
+
+	while (true){
+		CONTAR_GRUPO(hash);
+		const uint8_t *grupo = &tabla->control[g * TAM_GRUPO];
+		uint32_t candidatos = grupo_coincidencias(grupo, etiqueta);
+		while (candidatos){
+			size_t n = g * TAM_GRUPO + primer_bit(candidatos);
+			const entrada_snapshot_t *actual = &hash->entradas_imagen[tabla->indices[n]];
+			if (actual->hash == (uint64_t)h && actual->largo == clave->largo){
+				CONTAR(hash, comparaciones, 1);
+				if (!memcmp(imagen_clave(hash, actual), clave->clave, clave->largo)){
+					REGISTRAR_BUSQUEDA(hash, true);
+					return actual;
+				}
+			}
+			candidatos &= candidatos - 1;
+		}
+		if (grupo_coincidencias(grupo, CTRL_VACIO)){
+			REGISTRAR_BUSQUEDA(hash, false);
+			return NULL;
+		}
+		g = (g + 1) & mascara;
+	}
+}
+
+
+size_t hash_de_entrada(const hash_t *hash, uint32_t indice){
+	if (hash->imagen) return (size_t)hash->entradas_imagen[indice].hash;
+	return hash->entradas[indice].hash;
+}
+
+
+hash_clave_t hash_clave_preparar(const hash_t *hash, const char *clave, size_t largo){
+	hash_clave_t preparada = {clave, largo, hash->funcion_hash(clave, largo, hash->semilla)};
+	return preparada;
+}
+
+
+bool hash_guardar_clave(hash_t *hash, const hash_clave_t *clave, void *dato){
+	if (hash->imagen) return false;
+	avanzar_pendientes(hash);
+
+	campo_t *actual = buscar_campo(hash, clave, NULL, NULL);
+	if (actual){
+		if (hash->funcion_destruccion) hash->funcion_destruccion(actual->valor);
+		actual->valor = dato;
+		return true;
 	}
 
-	campo_t *actual = buscar_campo(hash, clave);
+	if (hash->usadas == hash->capacidad_entradas && !entradas_reservar(hash, hash->capacidad_entradas * FACTOR_REDIMENSION)) return false;
+
+	tabla_t *tabla = &hash->tabla;
+	if (((tabla->carga * 100) / tabla->capacidad) >= FACTOR_CARGA_MAX){
+		size_t capacidad_nueva = tabla->capacidad;
+		if (((hash->cantidad * 100) / tabla->capacidad) >= FACTOR_CARGA_MAX / 2) capacidad_nueva *= FACTOR_REDIMENSION;
+		if (!redimensionar(hash, capacidad_nueva)) return false;
+	}
+
+	campo_t *nuevo = &hash->entradas[hash->usadas];
+	if (!campo_copiar_clave(hash->arena, nuevo, clave->clave, clave->largo)) return false;
+	if (clave->largo > LARGO_CLAVE_CORTA) CONTAR(hash, bytes_claves, clave->largo + 1);
+	nuevo->valor = dato;
+	nuevo->hash = clave->hash;
+
+	tabla_agregar(tabla, clave->hash, (uint32_t)hash->usadas);
+	hash->usadas++;
+	hash->cantidad++;
+	return true;
+}
+
+
+void *hash_borrar_clave(hash_t *hash, const hash_clave_t *clave){
+	if (hash->imagen) return NULL;
+	avanzar_pendientes(hash);
+
+	tabla_t *tabla;
+	size_t n;
+	campo_t *actual = buscar_campo(hash, clave, &tabla, &n);
 	if (!actual) return NULL;
 
-	free(actual->clave);
-	actual->estado = BORRADO;
+	void *dato = actual->valor;
+	campo_liberar_clave(arena_de(hash, tabla->indices[n]), actual);
+	actual->largo = HUECO;
+	tabla_quitar(tabla, n);
 	hash->cantidad--;
-	return actual->valor;
+	hash->huecos++;
+
+	// Si no se puede achicar la tabla simplemente queda más grande.
+	size_t capacidad = hash->tabla.capacidad;
+	if (!migrando(hash) && capacidad / FACTOR_REDIMENSION >= hash->capacidad_minima && hash->cantidad * 100 < capacidad * FACTOR_CARGA_MIN){
+		redimensionar(hash, capacidad / FACTOR_REDIMENSION);
+	}
+	if (!hash->reorganizando && conviene_reorganizar(hash)){
+		comenzar_reorganizacion(hash);
+		reorganizar(hash, hash->incremental ? PASOS_REORGANIZACION : SIZE_MAX);
+	}
+	return dato;
 }
 
 
-void *hash_obtener(const hash_t *hash, const char *clave){
-	campo_t *actual = buscar_campo(hash, clave);
+void *hash_obtener_clave(const hash_t *hash, const hash_clave_t *clave){
+	if (hash->imagen){
+		const entrada_snapshot_t *entrada = imagen_buscar(hash, clave);
+		if (!entrada) return NULL;
+		return imagen_dato(hash, entrada);
+	}
+	campo_t *actual = buscar_campo(hash, clave, NULL, NULL);
 	if (!actual) return NULL;
 	return actual->valor;
 }
 
 
-bool hash_pertenece(const hash_t *hash, const char *clave){
-	campo_t *actual = buscar_campo(hash, clave);
+bool hash_pertenece_clave(const hash_t *hash, const hash_clave_t *clave){
+	if (hash->imagen) return imagen_buscar(hash, clave) != NULL;
+	campo_t *actual = buscar_campo(hash, clave, NULL, NULL);
 	if (!actual) return false;
 	else return true;
 }
 
 
+bool hash_guardar_n(hash_t *hash, const char *clave, size_t largo, void *dato){
+	hash_clave_t preparada = hash_clave_preparar(hash, clave, largo);
+	return hash_guardar_clave(hash, &preparada, dato);
+}
+
+
+void *hash_borrar_n(hash_t *hash, const char *clave, size_t largo){
+	hash_clave_t preparada = hash_clave_preparar(hash, clave, largo);
+	return hash_borrar_clave(hash, &preparada);
+}
+
+
+void *hash_obtener_n(const hash_t *hash, const char *clave, size_t largo){
+	hash_clave_t preparada = hash_clave_preparar(hash, clave, largo);
+	return hash_obtener_clave(hash, &preparada);
+}
+
+
+bool hash_pertenece_n(const hash_t *hash, const char *clave, size_t largo){
+	hash_clave_t preparada = hash_clave_preparar(hash, clave, largo);
+	return hash_pertenece_clave(hash, &preparada);
+}
+
+
+bool hash_guardar(hash_t *hash, const char *clave, void *dato){
+	return hash_guardar_n(hash, clave, strlen(clave), dato);
+}
+
+
+void *hash_borrar(hash_t *hash, const char *clave){
+	return hash_borrar_n(hash, clave, strlen(clave));
+}
+
+
+void *hash_obtener(const hash_t *hash, const char *clave){
+	return hash_obtener_n(hash, clave, strlen(clave));
+}
+
+
+bool hash_pertenece(const hash_t *hash, const char *clave){
+	return hash_pertenece_n(hash, clave, strlen(clave));
+}
+
+
+// Trae a caché lo que van a necesitar las búsquedas de un lote de claves ya
+// preparadas, para que sus fallos de caché se superpongan en lugar de
+// esperarse uno detrás de otro: primero los bytes de control del grupo
+// inicial de cada clave, una vez que están el índice del primer candidato y
+// por último la entrada a la que apunta.
+void precargar_lote(const hash_t *hash, const hash_clave_t *claves, size_t cantidad){
+	const tabla_t *tabla = &hash->tabla;
+	size_t mascara = MASCARA_GRUPOS(tabla->capacidad);
+	size_t candidato[TAM_LOTE];
+
+	for (size_t i = 0; i < cantidad; i++){
+		size_t g = GRUPO_INICIAL(claves[i].hash, mascara);
+		__builtin_prefetch(&tabla->control[g * TAM_GRUPO]);
+	}
+	for (size_t i = 0; i < cantidad; i++){
+		size_t g = GRUPO_INICIAL(claves[i].hash, mascara);
+		uint32_t candidatos = grupo_coincidencias(&tabla->control[g * TAM_GRUPO], ETIQUETA(claves[i].hash));
+		candidato[i] = candidatos ? g * TAM_GRUPO + primer_bit(candidatos) : tabla->capacidad;
+		if (candidatos) __builtin_prefetch(&tabla->indices[candidato[i]]);
+	}
+	for (size_t i = 0; i < cantidad; i++){
+		if (candidato[i] == tabla->capacidad) continue;
+		uint32_t indice = tabla->indices[candidato[i]];
+		if (hash->imagen) __builtin_prefetch(&hash->entradas_imagen[indice]);
+		else __builtin_prefetch(&hash->entradas[indice]);
+	}
+}
+
+
+void hash_obtener_lote(const hash_t *hash, const char *claves[], size_t cantidad, void *datos[]){
+	hash_clave_t preparadas[TAM_LOTE];
+
+	for (size_t inicio = 0; inicio < cantidad; inicio += TAM_LOTE){
+		size_t n = cantidad - inicio < TAM_LOTE ? cantidad - inicio : TAM_LOTE;
+		for (size_t i = 0; i < n; i++) preparadas[i] = hash_clave_preparar(hash, claves[inicio + i], strlen(claves[inicio + i]));
+		precargar_lote(hash, preparadas, n);
+		for (size_t i = 0; i < n; i++) datos[inicio + i] = hash_obtener_clave(hash, &preparadas[i]);
+	}
+}
+
+
+bool hash_guardar_lote(hash_t *hash, const char *claves[], void *datos[], size_t cantidad){
+	hash_clave_t preparadas[TAM_LOTE];
+
+	for (size_t inicio = 0; inicio < cantidad; inicio += TAM_LOTE){
+		size_t n = cantidad - inicio < TAM_LOTE ? cantidad - inicio : TAM_LOTE;
+		for (size_t i = 0; i < n; i++) preparadas[i] = hash_clave_preparar(hash, claves[inicio + i], strlen(claves[inicio + i]));
+		precargar_lote(hash, preparadas, n);
+		for (size_t i = 0; i < n; i++){
+			if (!hash_guardar_clave(hash, &preparadas[i], datos[inicio + i])) return false;
+		}
+	}
+	return true;
+}
+
+
 size_t hash_cantidad(const hash_t *hash){
 	return hash->cantidad;
 }
 
 
-hash_iter_t *hash_iter_crear(const hash_t *hash){
-	hash_iter_t *iter = malloc(sizeof(hash_iter_t));
-	if (!iter) return NULL;
+// Cantidad de grupos que recorre una búsqueda exitosa del índice en la posición n.
+size_t largo_sondeo(const hash_t *hash, const tabla_t *tabla, size_t n){
+	size_t mascara = MASCARA_GRUPOS(tabla->capacidad);
+	size_t inicial = GRUPO_INICIAL(hash_de_entrada(hash, tabla->indices[n]), mascara);
+	size_t g = n / TAM_GRUPO;
+	return ((g - inicial) & mascara) + 1;
+}
 
-	iter->hash = hash;
 
-	if (hash->cantidad == 0) iter->actual = NULL;
+// Suma los largos de sondeo de los índices de la tabla y actualiza el máximo.
+size_t tabla_sondeo(const hash_t *hash, const tabla_t *tabla, size_t *maximo){
+	size_t total = 0;
+	for (size_t i = 0; i < tabla->capacidad; i++){
+		if (tabla->control[i] & 0x80) continue;
+		size_t largo = largo_sondeo(hash, tabla, i);
+		if (largo > *maximo) *maximo = largo;
+		total += largo;
+	}
+	return total;
+}
 
-	else {
-		campo_t *actual;
-		for (size_t i = 0; i < hash->capacidad; i++){
-			actual = &hash->tabla[i];
-			if (actual->estado == OCUPADO){
-				iter->posicion_actual = i;
-				iter->actual = actual;
-				break;
-			}
-		}
+
+size_t hash_sondeo_maximo(const hash_t *hash){
+	size_t maximo = 0;
+	tabla_sondeo(hash, &hash->tabla, &maximo);
+	if (migrando(hash)) tabla_sondeo(hash, &hash->vieja, &maximo);
+	return maximo;
+}
+
+
+double hash_sondeo_medio(const hash_t *hash){
+	if (hash->cantidad == 0) return 0;
+	size_t maximo = 0;
+	size_t total = tabla_sondeo(hash, &hash->tabla, &maximo);
+	if (migrando(hash)) total += tabla_sondeo(hash, &hash->vieja, &maximo);
+	return (double)total / (double)hash->cantidad;
+}
+
+
+bool escribir_bytes(FILE *archivo, const void *bytes, size_t largo, size_t *posicion){
+	*posicion += largo;
+	return fwrite(bytes, 1, largo, archivo) == largo;
+}
+
+
+bool escribir_ceros(FILE *archivo, size_t largo, size_t *posicion){
+	static const char ceros[4096] = {0};
+	while (largo > sizeof(ceros)){
+		if (!escribir_bytes(archivo, ceros, sizeof(ceros), posicion)) return false;
+		largo -= sizeof(ceros);
 	}
+	return escribir_bytes(archivo, ceros, largo, posicion);
+}
 
-	return iter;
+
+// Escribe ceros hasta que la posición quede alineada a ALINEACION_SNAPSHOT.
+bool escribir_relleno(FILE *archivo, size_t *posicion){
+	size_t relleno = (ALINEACION_SNAPSHOT - *posicion % ALINEACION_SNAPSHOT) % ALINEACION_SNAPSHOT;
+	return escribir_ceros(archivo, relleno, posicion);
 }
 
 
-bool hash_iter_al_final(const hash_iter_t *iter){
-	return iter->actual == NULL;
+// Escribe el snapshot del hash en un archivo ya abierto. Las claves y los
+// datos se escriben primero, a continuación del lugar que ocupan las
+// entradas, para conocer sus desplazamientos; después se vuelve al
+// principio a escribir la cabecera, la tabla y las entradas.
+bool escribir_snapshot(const hash_t *hash, FILE *archivo, hash_serializar_dato_t serializar_dato){
+	size_t capacidad = capacidad_para(hash->cantidad);
+	tabla_t tabla;
+	if (!tabla_crear(&tabla, capacidad)) return false;
+	entrada_snapshot_t *entradas = malloc(sizeof(entrada_snapshot_t) * (hash->cantidad + 1));
+	if (!entradas){
+		free(tabla.control);
+		return false;
+	}
+
+	cabecera_snapshot_t cabecera = {0};
+	memcpy(cabecera.magia, MAGIA_SNAPSHOT, sizeof(cabecera.magia));
+	cabecera.version = VERSION_SNAPSHOT;
+	cabecera.orden = ORDEN_SNAPSHOT;
+	cabecera.semilla = hash->semilla;
+	cabecera.cantidad = hash->cantidad;
+	cabecera.capacidad = capacidad;
+	cabecera.control = (sizeof(cabecera) + ALINEACION_SNAPSHOT - 1) / ALINEACION_SNAPSHOT * ALINEACION_SNAPSHOT;
+	cabecera.indices = cabecera.control + capacidad;
+	cabecera.entradas = cabecera.indices + sizeof(uint32_t) * capacidad;
+
+	// El lugar de la cabecera, la tabla y las entradas se llena con ceros en
+	// lugar de saltearlo con fseek, que recibe un long y en algunas
+	// plataformas no llega más allá de 2 GiB.
+	size_t posicion = 0;
+	bool ok = escribir_ceros(archivo, cabecera.entradas + sizeof(entrada_snapshot_t) * hash->cantidad, &posicion);
+	size_t n = 0;
+	for (size_t i = 0; ok && i < hash->usadas; i++){
+		const campo_t *campo = &hash->entradas[i];
+		if (campo->largo == HUECO) continue;
+
+		tabla_agregar(&tabla, campo->hash, (uint32_t)n);
+		entrada_snapshot_t *entrada = &entradas[n++];
+		entrada->hash = campo->hash;
+		entrada->largo = campo->largo;
+		entrada->clave = posicion;
+		entrada->dato = 0;
+		entrada->largo_dato = 0;
+		ok = escribir_bytes(archivo, campo_clave(campo), campo->largo + 1, &posicion);
+		if (!ok || !serializar_dato) continue;
+
+		size_t largo;
+		const void *bytes = serializar_dato(campo->valor, &largo);
+		ok = escribir_relleno(archivo, &posicion);
+		entrada->dato = posicion;
+		entrada->largo_dato = largo;
+		ok = ok && escribir_bytes(archivo, bytes, largo, &posicion);
+	}
+	cabecera.tamanio = posicion;
+
+	size_t inicio = 0;
+	ok = ok && fseek(archivo, 0, SEEK_SET) == 0;
+	ok = ok && escribir_bytes(archivo, &cabecera, sizeof(cabecera), &inicio) && escribir_relleno(archivo, &inicio);
+	ok = ok && escribir_bytes(archivo, tabla.control, capacidad, &inicio);
+	ok = ok && escribir_bytes(archivo, tabla.indices, sizeof(uint32_t) * capacidad, &inicio);
+	ok = ok && escribir_bytes(archivo, entradas, sizeof(entrada_snapshot_t) * n, &inicio);
+
+	free(entradas);
+	free(tabla.control);
+	return ok;
 }
 
 
-bool hash_iter_avanzar(hash_iter_t *iter){
-	if (hash_iter_al_final(iter)) return false;
-	campo_t *actual = iter->actual;
+bool hash_guardar_snapshot(const hash_t *hash, const char *ruta, hash_serializar_dato_t serializar_dato){
+	if (hash->imagen) return false;
+
+	// Se escribe a un archivo temporal y se lo renombra al final, para que
+	// quien abra la ruta nunca vea un snapshot a medio escribir.
+	size_t largo = strlen(ruta);
+	char *temporal = malloc(largo + sizeof(".tmp"));
+	if (!temporal) return false;
+	memcpy(temporal, ruta, largo);
+	memcpy(temporal + largo, ".tmp", sizeof(".tmp"));
+
+	FILE *archivo = fopen(temporal, "wb");
+	bool ok = archivo && escribir_snapshot(hash, archivo, serializar_dato);
+	if (archivo && fclose(archivo) != 0) ok = false;
+	if (ok) ok = rename(temporal, ruta) == 0;
+	if (!ok) remove(temporal);
+	free(temporal);
+	return ok;
+}
+
+
+// Comprueba que la cabecera sea la de un snapshot de esta versión, escrito
+// con el mismo orden de bytes, y que sus secciones entren en el archivo.
+bool cabecera_valida(const uint8_t *imagen, size_t tamanio){
+	if (tamanio < sizeof(cabecera_snapshot_t)) return false;
+	const cabecera_snapshot_t *cabecera = (const cabecera_snapshot_t *)imagen;
+
+	if (memcmp(cabecera->magia, MAGIA_SNAPSHOT, sizeof(cabecera->magia)) != 0) return false;
+	if (cabecera->version != VERSION_SNAPSHOT || cabecera->orden != ORDEN_SNAPSHOT || cabecera->tamanio != tamanio) return false;
+
+	// Las cotas van de a una para que ninguna cuenta desborde: la capacidad
+	// y la cantidad quedan acotadas por el tamaño antes de multiplicarlas.
+	uint64_t capacidad = cabecera->capacidad;
+	if (capacidad < TAM_GRUPO || capacidad > tamanio || (capacidad & (capacidad - 1))) return false;
+	if (cabecera->cantidad > capacidad || cabecera->cantidad * 100 > capacidad * FACTOR_CARGA_MAX) return false;
+	if (cabecera->control < sizeof(cabecera_snapshot_t) || cabecera->control > tamanio || cabecera->control % ALINEACION_SNAPSHOT) return false;
+	if (cabecera->indices != cabecera->control + capacidad || cabecera->entradas != cabecera->indices + sizeof(uint32_t) * capacidad) return false;
+	return cabecera->entradas <= tamanio && sizeof(entrada_snapshot_t) * cabecera->cantidad <= tamanio - cabecera->entradas;
+}
+
+
+// Comprueba el contenido de un snapshot de cabecera válida, para que ni las
+// búsquedas ni los recorridos lean fuera de la imagen: cada posición ocupada
+// de la tabla apunta a una entrada que existe, queda al menos una posición
+// vacía donde terminar una búsqueda fallida, y cada entrada tiene su clave,
+// terminada en cero, y todos los bytes de su dato dentro del archivo.
+bool snapshot_valido(const uint8_t *imagen, size_t tamanio){
+	if (!cabecera_valida(imagen, tamanio)) return false;
+	const cabecera_snapshot_t *cabecera = (const cabecera_snapshot_t *)imagen;
+
+	const uint8_t *control = imagen + cabecera->control;
+	const uint32_t *indices = (const uint32_t *)(imagen + cabecera->indices);
+	bool hay_vacia = false;
+	for (size_t i = 0; i < cabecera->capacidad; i++){
+		if (control[i] == CTRL_VACIO) hay_vacia = true;
+		else if (control[i] < CTRL_VACIO && indices[i] >= cabecera->cantidad) return false;
+	}
+	if (!hay_vacia) return false;
+
+	const entrada_snapshot_t *entradas = (const entrada_snapshot_t *)(imagen + cabecera->entradas);
+	for (size_t i = 0; i < cabecera->cantidad; i++){
+		const entrada_snapshot_t *entrada = &entradas[i];
+		if (entrada->largo >= tamanio || entrada->clave > tamanio - entrada->largo - 1) return false;
+		if (imagen[entrada->clave + entrada->largo] != '\0') return false;
+		if (entrada->dato == 0 && entrada->largo_dato != 0) return false;
+		if (entrada->dato >= tamanio || entrada->largo_dato > tamanio - entrada->dato) return false;
+	}
+	return true;
+}
+
+
+hash_t *abrir_snapshot(const char *ruta, hash_funcion_t funcion_hash){
+	size_t tamanio;
+	const uint8_t *imagen = cargar_imagen(ruta, &tamanio);
+	if (!imagen) return NULL;
+
+	hash_t *hash = snapshot_valido(imagen, tamanio) ? malloc(sizeof(hash_t)) : NULL;
+	if (!hash){
+		descargar_imagen(imagen, tamanio);
+		return NULL;
+	}
+
+	const cabecera_snapshot_t *cabecera = (const cabecera_snapshot_t *)imagen;
+	memset(hash, 0, sizeof(hash_t));
+	hash->imagen = imagen;
+	hash->tam_imagen = tamanio;
+	hash->entradas_imagen = (const entrada_snapshot_t *)(imagen + cabecera->entradas);
+	// La tabla nunca se modifica, así que puede apuntar a la imagen.
+	hash->tabla.control = (uint8_t *)(imagen + cabecera->control);
+	hash->tabla.indices = (uint32_t *)(imagen + cabecera->indices);
+	hash->tabla.capacidad = cabecera->capacidad;
+	hash->tabla.cantidad = cabecera->cantidad;
+	hash->tabla.carga = cabecera->cantidad;
+	hash->cantidad = cabecera->cantidad;
+	hash->capacidad_minima = cabecera->capacidad;
+	hash->funcion_hash = funcion_hash;
+	hash->semilla = (size_t)cabecera->semilla;
+	return hash;
+}
+
 
-	for (size_t i = iter->posicion_actual + 1; i < iter->hash->capacidad; i++){
-		actual = &iter->hash->tabla[i];
-		if (actual->estado == OCUPADO){
+hash_t *hash_abrir_snapshot(const char *ruta){
+	return abrir_snapshot(ruta, wyhash);
+}
+
+
+hash_t *hash_abrir_snapshot_con_funcion(const char *ruta, hash_funcion_t funcion_hash){
+	return abrir_snapshot(ruta, funcion_hash);
+}
+
+
+void *hash_obtener_snapshot(const hash_t *hash, const char *clave, size_t *largo){
+	*largo = 0;
+	if (!hash->imagen) return NULL;
+	hash_clave_t preparada = hash_clave_preparar(hash, clave, strlen(clave));
+	const entrada_snapshot_t *entrada = imagen_buscar(hash, &preparada);
+	if (!entrada) return NULL;
+	*largo = (size_t)entrada->largo_dato;
+	return imagen_dato(hash, entrada);
+}
+
+
+#ifdef HASH_ESTADISTICAS
+hash_estadisticas_t hash_obtener_estadisticas(const hash_t *hash){
+	hash_estadisticas_t estadisticas = hash->estadisticas;
+	estadisticas.borrados = hash->tabla.carga - hash->tabla.cantidad;
+	if (migrando(hash)) estadisticas.borrados += hash->vieja.carga - hash->vieja.cantidad;
+	estadisticas.huecos = hash->imagen ? 0 : hash->usadas - hash->cantidad;
+	return estadisticas;
+}
+
+
+void hash_reiniciar_estadisticas(hash_t *hash){
+	memset(&hash->estadisticas, 0, sizeof(hash->estadisticas));
+}
+#endif
+
+
+// Cantidad de posiciones del arreglo de entradas, contando los huecos.
+size_t entradas_usadas(const hash_t *hash){
+	return hash->imagen ? hash->cantidad : hash->usadas;
+}
+
+
+// Devuelve la clave de la entrada en la posición dada, o NULL si es un hueco.
+const char *clave_en(const hash_t *hash, size_t posicion){
+	if (hash->imagen) return imagen_clave(hash, &hash->entradas_imagen[posicion]);
+	const campo_t *campo = &hash->entradas[posicion];
+	if (campo->largo == HUECO) return NULL;
+	return campo_clave(campo);
+}
+
+
+void hash_iterar(hash_t *hash, bool visitar(const char *clave, void *dato, void *extra), void *extra){
+	size_t usadas = entradas_usadas(hash);
+	for (size_t i = 0; i < usadas; i++){
+		const char *clave = clave_en(hash, i);
+		if (!clave) continue;
+		void *dato = hash->imagen ? imagen_dato(hash, &hash->entradas_imagen[i]) : hash->entradas[i].valor;
+		if (!visitar(clave, dato, extra)) return;
+	}
+}
+
+
+// Deja el iterador en la primera entrada que no es un hueco desde la
+// posición dada, o al final si no hay más.
+void iter_buscar_desde(hash_iter_t *iter, size_t posicion){
+	const hash_t *hash = iter->hash;
+	size_t usadas = entradas_usadas(hash);
+
+	for (size_t i = posicion; i < usadas; i++){
+		const char *clave = clave_en(hash, i);
+		if (clave){
 			iter->posicion_actual = i;
-			iter->actual = actual;
-			return true;;
+			iter->actual = clave;
+			return;
 		}
 	}
+	iter->actual = NULL;
+}
+
 
+hash_iter_t *hash_iter_crear(const hash_t *hash){
+	hash_iter_t *iter = malloc(sizeof(hash_iter_t));
+	if (!iter) return NULL;
+
+	iter->hash = hash;
 	iter->actual = NULL;
-	return false;
+	if (hash->cantidad != 0) iter_buscar_desde(iter, 0);
+	return iter;
+}
+
+
+bool hash_iter_al_final(const hash_iter_t *iter){
+	return iter->actual == NULL;
+}
+
+
+bool hash_iter_avanzar(hash_iter_t *iter){
+	if (hash_iter_al_final(iter)) return false;
+	iter_buscar_desde(iter, iter->posicion_actual + 1);
+	return !hash_iter_al_final(iter);
 }
 
 
 const char *hash_iter_ver_actual(const hash_iter_t *iter){
-	if (hash_iter_al_final(iter)) return NULL;
-	return iter->actual->clave;
+	return iter->actual;
 }
 
 
 void hash_iter_destruir(hash_iter_t *iter){
 	free(iter);
-}
\ No newline at end of file
+}
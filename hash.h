@@ -14,10 +14,52 @@ typedef struct hash_iter hash_iter_t;
 // tipo de función para destruir dato
 typedef void (*hash_destruir_dato_t)(void *);
 
+// tipo de función de hash: recibe la clave, su largo y la semilla de la tabla
+typedef size_t (*hash_funcion_t)(const char *clave, size_t largo, size_t semilla);
+
+// tipo de función para serializar dato: devuelve los bytes que lo
+// representan y guarda su cantidad en largo
+typedef const void *(*hash_serializar_dato_t)(void *dato, size_t *largo);
+
+/* Función de hash por defecto (wyhash). Puede usarse dentro de una función
+ * de hash propia.
+ */
+size_t wyhash(const char *clave, size_t largo, size_t semilla);
+
+/* Genera una semilla al azar para wyhash, distinta en cada llamada. Usa la
+ * entropía del sistema si está disponible y si no, mezcla la hora, el reloj,
+ * un contador y la dirección que se le pasa (por ejemplo la de la tabla que
+ * la va a usar). Puede llamarse desde varios hilos a la vez.
+ */
+size_t hash_generar_semilla(const void *direccion);
+
+/* Clave preparada: la clave junto con su largo y su hash ya calculado.
+ * Se obtiene con hash_clave_preparar y sirve para operar varias veces con
+ * la misma clave sin volver a hashearla. Sus campos no deben modificarse.
+ */
+typedef struct hash_clave {
+	const char *clave;
+	size_t largo;
+	size_t hash;
+} hash_clave_t;
+
 /* Crea el hash
  */
 hash_t *hash_crear(hash_destruir_dato_t destruir_dato);
 
+/* Crea el hash con lugar para cantidad elementos: guardar hasta esa
+ * cantidad de claves no redimensiona la tabla, y borrar no la achica por
+ * debajo de ese tamaño. Devuelve NULL si no pudo pedir la memoria o si
+ * cantidad supera los UINT32_MAX elementos que puede guardar un hash.
+ */
+hash_t *hash_crear_con_capacidad(hash_destruir_dato_t destruir_dato, size_t cantidad);
+
+/* Crea el hash usando funcion_hash en lugar de la función de hash por
+ * defecto. La función recibe una semilla aleatoria elegida al crear la
+ * tabla, que debería usar para que los hashes no puedan predecirse.
+ */
+hash_t *hash_crear_con_funcion(hash_destruir_dato_t destruir_dato, hash_funcion_t funcion_hash);
+
 /* Guarda un elemento en el hash, si la clave ya se encuentra en la
  * estructura, la reemplaza. De no poder guardarlo devuelve false.
  * Pre: La estructura hash fue inicializada
@@ -44,6 +86,22 @@ void *hash_obtener(const hash_t *hash, const char *clave);
  */
 bool hash_pertenece(const hash_t *hash, const char *clave);
 
+/* Obtiene los valores de cantidad claves a la vez y los deja en datos, en
+ * el mismo orden (NULL para las que no están). Es equivalente a llamar a
+ * hash_obtener con cada una, pero superpone los accesos a memoria de
+ * varias búsquedas, lo que rinde cuando la tabla no entra en la caché.
+ * Pre: La estructura hash fue inicializada y datos tiene lugar para
+ * cantidad punteros
+ */
+void hash_obtener_lote(const hash_t *hash, const char *claves[], size_t cantidad, void *datos[]);
+
+/* Guarda los pares (claves[i], datos[i]) como si se llamara a hash_guardar
+ * con cada uno, en orden y superponiendo sus accesos a memoria. Si no puede
+ * guardar alguno devuelve false; los anteriores quedan guardados.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_guardar_lote(hash_t *hash, const char *claves[], void *datos[], size_t cantidad);
+
 /* Devuelve la cantidad de elementos del hash.
  * Pre: La estructura hash fue inicializada
  */
@@ -56,7 +114,160 @@ size_t hash_cantidad(const hash_t *hash);
  */
 void hash_destruir(hash_t *hash);
 
-/* Iterador del hash */
+/* Variantes de las primitivas anteriores que reciben el largo de la clave.
+ * La clave no necesita terminar en '\0' y puede apuntar al interior de un
+ * buffer más grande; el hash guarda su propia copia terminada en '\0'.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_guardar_n(hash_t *hash, const char *clave, size_t largo, void *dato);
+void *hash_borrar_n(hash_t *hash, const char *clave, size_t largo);
+void *hash_obtener_n(const hash_t *hash, const char *clave, size_t largo);
+bool hash_pertenece_n(const hash_t *hash, const char *clave, size_t largo);
+
+/* Prepara una clave de largo dado para usarla con las primitivas _clave.
+ * No copia la clave: debe seguir siendo válida mientras se use la clave
+ * preparada, que solo sirve para el hash recibido.
+ * Pre: La estructura hash fue inicializada
+ */
+hash_clave_t hash_clave_preparar(const hash_t *hash, const char *clave, size_t largo);
+
+/* Variantes de las primitivas anteriores que reciben una clave preparada
+ * con hash_clave_preparar y no vuelven a calcular su hash.
+ * Pre: La estructura hash fue inicializada y la clave se preparó para él
+ */
+bool hash_guardar_clave(hash_t *hash, const hash_clave_t *clave, void *dato);
+void *hash_borrar_clave(hash_t *hash, const hash_clave_t *clave);
+void *hash_obtener_clave(const hash_t *hash, const hash_clave_t *clave);
+bool hash_pertenece_clave(const hash_t *hash, const hash_clave_t *clave);
+
+/* Asegura lugar para cantidad elementos en total, redimensionando una sola
+ * vez si hace falta. Mientras el hash no supere esa cantidad no vuelve a
+ * crecer, y borrar no lo achica por debajo de ese tamaño. Devuelve false si
+ * no pudo pedir la memoria o si cantidad supera los UINT32_MAX elementos
+ * que puede guardar un hash.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_reservar(hash_t *hash, size_t cantidad);
+
+/* Activa o desactiva el modo de redimensión incremental. En ese modo, al
+ * redimensionar se conservan la tabla anterior y la nueva, y cada guardado
+ * o borrado posterior muda una cantidad acotada de campos de una a otra,
+ * así ninguna operación individual reconstruye la tabla entera. Al
+ * desactivarlo se termina cualquier migración pendiente.
+ * Pre: La estructura hash fue inicializada
+ */
+void hash_redimension_incremental(hash_t *hash, bool incremental);
+
+/* Hace que el hash guarde las claves largas empaquetadas en bloques grandes
+ * propios (una arena) en lugar de pedir memoria para cada una. Las claves
+ * cortas se guardan siempre dentro de la tabla. El espacio de las claves
+ * borradas se recupera al reorganizar las entradas. Devuelve false si no
+ * pudo crear la arena.
+ * Pre: La estructura hash fue inicializada y está vacía
+ */
+bool hash_usar_arena(hash_t *hash);
+
+/* Devuelve el largo máximo de sondeo, en grupos de posiciones recorridos,
+ * entre las claves guardadas. Es 0 si el hash está vacío.
+ * Pre: La estructura hash fue inicializada
+ */
+size_t hash_sondeo_maximo(const hash_t *hash);
+
+/* Devuelve el largo medio de sondeo, en grupos de posiciones recorridos,
+ * de una búsqueda exitosa. Es 0 si el hash está vacío.
+ * Pre: La estructura hash fue inicializada
+ */
+double hash_sondeo_medio(const hash_t *hash);
+
+#ifdef HASH_ESTADISTICAS
+/* Estadísticas del hash. Solo existen si se compila con HASH_ESTADISTICAS
+ * definido; sin él no se cuenta nada y no cuestan nada. Con él, también las
+ * búsquedas sobre un const hash_t * escriben los contadores, así que ya no
+ * pueden hacerse desde varios hilos a la vez sobre el mismo hash.
+ */
+
+#define HASH_LARGO_HISTOGRAMA 16
+
+typedef struct hash_estadisticas {
+	// Búsquedas según la cantidad de grupos que recorrieron: sondeos[i]
+	// cuenta las que recorrieron i + 1; la última posición cuenta también
+	// las más largas.
+	size_t sondeos[HASH_LARGO_HISTOGRAMA];
+	size_t busquedas_exitosas;
+	size_t busquedas_fallidas;
+	// Comparaciones de claves completas, hechas cuando coinciden la
+	// etiqueta y el hash.
+	size_t comparaciones;
+	// Marcas de borrado que hay ahora en la tabla y huecos en las entradas.
+	size_t borrados;
+	size_t huecos;
+	size_t redimensiones;
+	double segundos_redimension;
+	size_t reorganizaciones;
+	double segundos_reorganizacion;
+	// Bytes pedidos para copiar claves largas.
+	size_t bytes_claves;
+} hash_estadisticas_t;
+
+/* Devuelve las estadísticas acumuladas desde que se creó el hash o desde
+ * la última vez que se reiniciaron. Cuentan también las búsquedas que
+ * hacen guardar y borrar.
+ * Pre: La estructura hash fue inicializada
+ */
+hash_estadisticas_t hash_obtener_estadisticas(const hash_t *hash);
+
+/* Pone en cero las estadísticas acumuladas.
+ * Pre: La estructura hash fue inicializada
+ */
+void hash_reiniciar_estadisticas(hash_t *hash);
+#endif
+
+/* Recorre los elementos del hash en orden de inserción hasta que no haya
+ * más o hasta que visitar devuelva false. No debe guardarse ni borrarse
+ * nada del hash mientras se lo recorre.
+ * Pre: La estructura hash fue inicializada
+ */
+void hash_iterar(hash_t *hash, bool visitar(const char *clave, void *dato, void *extra), void *extra);
+
+/* Escribe en el archivo de la ruta una imagen del hash que puede volver a
+ * abrirse con hash_abrir_snapshot. Cada dato se guarda como los bytes que
+ * devuelve serializar_dato; si es NULL los datos no se guardan. El archivo
+ * se escribe aparte y reemplaza al anterior recién cuando está completo.
+ * Devuelve false si no pudo escribirlo.
+ * Pre: La estructura hash fue inicializada y no fue abierta de un snapshot
+ */
+bool hash_guardar_snapshot(const hash_t *hash, const char *ruta, hash_serializar_dato_t serializar_dato);
+
+/* Abre un snapshot escrito por hash_guardar_snapshot proyectando el archivo
+ * en memoria, sin copiar ni pedir memoria para cada clave; varios procesos
+ * que abren el mismo archivo comparten sus páginas. El hash que devuelve es
+ * de solo lectura: guardar y borrar fallan. hash_obtener devuelve un puntero
+ * a los bytes serializados del dato dentro del archivo (o NULL si no se
+ * guardaron datos), que valen hasta destruir el hash; hash_obtener_snapshot
+ * devuelve además cuántos bytes son. El archivo debe haber
+ * sido escrito en una máquina con el mismo orden de bytes. Al abrirlo se
+ * recorren la tabla y las entradas para comprobar que ningún desplazamiento
+ * apunte fuera del archivo. Devuelve NULL si no pudo abrirlo o no es un
+ * snapshot válido, por ejemplo si está truncado o dañado.
+ * Pre: El snapshot se escribió desde un hash con la función de hash por defecto
+ */
+hash_t *hash_abrir_snapshot(const char *ruta);
+
+/* Como hash_abrir_snapshot, para un snapshot escrito desde un hash creado
+ * con hash_crear_con_funcion.
+ * Pre: funcion_hash es la misma con la que se creó el hash original
+ */
+hash_t *hash_abrir_snapshot_con_funcion(const char *ruta, hash_funcion_t funcion_hash);
+
+/* Como hash_obtener, para un hash abierto de un snapshot: devuelve el
+ * puntero a los bytes serializados del dato y guarda en largo cuántos son,
+ * que es el largo que devolvió serializar_dato al escribirlo. Devuelve NULL
+ * con largo en 0 si la clave no está, si el snapshot no guarda datos o si
+ * el hash no fue abierto de un snapshot.
+ */
+void *hash_obtener_snapshot(const hash_t *hash, const char *clave, size_t *largo);
+
+/* Iterador del hash. Recorre los elementos en orden de inserción. */
 
 
 // Crea iterador
@@ -0,0 +1,539 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "hash_concurrente.h"
+#include <stdio.h>
+
+
+#define BITS_SEGMENTO 6
+#define SEGMENTOS (1 << BITS_SEGMENTO)
+#define TAM_INICIAL 16
+#define FACTOR_CARGA_MAX 70
+#define FACTOR_REDIMENSION 2
+#define LINEA_CACHE 64
+#define RETIROS_POR_AVANCE 64
+#define EPOCA_INACTIVA UINT64_MAX
+
+
+// Las claves se guardan en objetos inmutables: una vez publicados en una
+// ranura solo se reemplaza el puntero, nunca su contenido, así un lector
+// puede compararlas sin lock.
+typedef struct clave_conc{
+	size_t largo;
+	char datos[];
+} clave_conc_t;
+
+
+// Una ranura vacía tiene clave NULL y una borrada apunta a marca_borrada.
+static char marca_borrada;
+#define BORRADA ((clave_conc_t *)&marca_borrada)
+
+
+typedef struct ranura{
+	_Atomic(clave_conc_t *) clave;
+	_Atomic(size_t) hash;
+	_Atomic(void *) valor;
+} ranura_t;
+
+
+typedef struct tabla_conc{
+	size_t capacidad;
+	ranura_t ranuras[];
+} tabla_conc_t;
+
+
+// Cada segmento es una tabla de hash abierta con su propio lock para las
+// escrituras y un contador de versión que queda impar mientras se escribe.
+// Los lectores leen la versión antes y después de buscar, y si cambió o
+// era impar reintentan.
+typedef struct segmento{
+	_Alignas(LINEA_CACHE) pthread_mutex_t mutex;
+	_Atomic(unsigned) version;
+	_Atomic(tabla_conc_t *) tabla;
+	_Atomic(size_t) cantidad;
+	size_t carga;
+} segmento_t;
+
+
+// Recolección por épocas: cada hilo que opera sobre el hash anuncia la
+// época global que vio al entrar y EPOCA_INACTIVA al salir. Lo que un
+// escritor desengancha en la época e se guarda en su lista de retirados y
+// se libera cuando la época global llega a e + 2, porque para entonces
+// ningún hilo que pudiera verlo sigue adentro.
+//
+// La lista de participantes solo crece: los lectores la recorren sin lock,
+// así que un registro no puede sacarse mientras el hash exista. El de un
+// hilo que terminó queda inactivo, sin frenar el avance de las épocas, y
+// se libera junto con lo que tenga retirado al destruir el hash.
+typedef struct retirado{
+	struct retirado *siguiente;
+	void *puntero;
+	void (*liberar)(void *);
+} retirado_t;
+
+
+typedef struct participante{
+	_Alignas(LINEA_CACHE) _Atomic(uint64_t) epoca;
+	pthread_t duenio;
+	struct participante *siguiente;
+	retirado_t *limbo[3];
+	uint64_t limbo_epoca[3];
+	size_t retiros;
+} participante_t;
+
+
+struct hash_concurrente{
+	segmento_t segmentos[SEGMENTOS];
+	_Atomic(uint64_t) epoca;
+	_Atomic(participante_t *) participantes;
+	uint64_t id;
+	hash_destruir_dato_t funcion_destruccion;
+	size_t semilla;
+};
+
+
+static _Atomic(uint64_t) proximo_id = 1;
+static _Thread_local uint64_t id_cacheado = 0;
+static _Thread_local participante_t *participante_cacheado = NULL;
+
+
+static inline void pausa(void){
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+
+/* Épocas */
+
+
+// Devuelve el registro del hilo actual para este hash, creándolo la primera
+// vez. Devuelve NULL si no pudo pedir memoria.
+static participante_t *participante_propio(hash_concurrente_t *hash){
+	if (id_cacheado == hash->id) return participante_cacheado;
+
+	pthread_t yo = pthread_self();
+	participante_t *p = atomic_load_explicit(&hash->participantes, memory_order_acquire);
+	while (p && !pthread_equal(p->duenio, yo)) p = p->siguiente;
+
+	if (!p){
+		p = aligned_alloc(LINEA_CACHE, sizeof(participante_t));
+		if (!p) return NULL;
+		atomic_init(&p->epoca, EPOCA_INACTIVA);
+		p->duenio = yo;
+		p->retiros = 0;
+		for (size_t i = 0; i < 3; i++){
+			p->limbo[i] = NULL;
+			p->limbo_epoca[i] = 0;
+		}
+		p->siguiente = atomic_load_explicit(&hash->participantes, memory_order_relaxed);
+		while (!atomic_compare_exchange_weak_explicit(&hash->participantes, &p->siguiente, p, memory_order_release, memory_order_relaxed));
+	}
+
+	id_cacheado = hash->id;
+	participante_cacheado = p;
+	return p;
+}
+
+
+static participante_t *entrar(hash_concurrente_t *hash){
+	participante_t *p = participante_propio(hash);
+	if (!p) return NULL;
+	atomic_store_explicit(&p->epoca, atomic_load_explicit(&hash->epoca, memory_order_relaxed), memory_order_release);
+	atomic_thread_fence(memory_order_seq_cst);
+	return p;
+}
+
+
+static void salir(participante_t *p){
+	if (p) atomic_store_explicit(&p->epoca, EPOCA_INACTIVA, memory_order_release);
+}
+
+
+// Avanza la época global si todos los hilos que están adentro ya la vieron.
+static bool intentar_avanzar(hash_concurrente_t *hash){
+	uint64_t epoca = atomic_load_explicit(&hash->epoca, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+
+	participante_t *p = atomic_load_explicit(&hash->participantes, memory_order_acquire);
+	for (; p; p = p->siguiente){
+		// Con acquire, lo que leyó cada hilo antes de salir o de pasar de
+		// época queda antes del avance y, por lo tanto, antes de liberar.
+		uint64_t vista = atomic_load_explicit(&p->epoca, memory_order_acquire);
+		if (vista != EPOCA_INACTIVA && vista != epoca) return false;
+	}
+	return atomic_compare_exchange_strong(&hash->epoca, &epoca, epoca + 1);
+}
+
+
+static void liberar_lista(retirado_t *lista){
+	while (lista){
+		retirado_t *siguiente = lista->siguiente;
+		lista->liberar(lista->puntero);
+		free(lista);
+		lista = siguiente;
+	}
+}
+
+
+// Libera las listas del participante retiradas hace al menos dos épocas.
+static void liberar_viejos(participante_t *p, uint64_t epoca){
+	for (size_t i = 0; i < 3; i++){
+		if (p->limbo[i] && p->limbo_epoca[i] + 2 <= epoca){
+			liberar_lista(p->limbo[i]);
+			p->limbo[i] = NULL;
+		}
+	}
+}
+
+
+// Entrega puntero para que se libere con liberar cuando ningún lector
+// pueda estar usándolo.
+// Pre: puntero ya no es alcanzable desde el hash.
+static void retirar(hash_concurrente_t *hash, participante_t *p, void *puntero, void (*liberar)(void *)){
+	// La escritura que desenganchó puntero tiene que quedar visible antes de
+	// leer la época con la que se lo marca; si no, un lector que entre en la
+	// época siguiente todavía podría encontrarlo. Es el par de la barrera de
+	// entrar.
+	atomic_thread_fence(memory_order_seq_cst);
+	retirado_t *nodo = p ? malloc(sizeof(retirado_t)) : NULL;
+	if (!nodo){
+		// Sin lista de retirados se espera a que pasen dos épocas. El hilo
+		// sale mientras tanto para no frenar el avance él mismo.
+		uint64_t epoca = atomic_load(&hash->epoca);
+		salir(p);
+		while (atomic_load(&hash->epoca) < epoca + 2){
+			if (!intentar_avanzar(hash)) pausa();
+		}
+		liberar(puntero);
+		if (p) entrar(hash);
+		return;
+	}
+
+	uint64_t epoca = atomic_load_explicit(&hash->epoca, memory_order_acquire);
+	liberar_viejos(p, epoca);
+	size_t i = epoca % 3;
+	nodo->puntero = puntero;
+	nodo->liberar = liberar;
+	nodo->siguiente = p->limbo[i];
+	p->limbo[i] = nodo;
+	p->limbo_epoca[i] = epoca;
+
+	if (++p->retiros % RETIROS_POR_AVANCE == 0 && intentar_avanzar(hash)){
+		liberar_viejos(p, atomic_load_explicit(&hash->epoca, memory_order_relaxed));
+	}
+}
+
+
+/* Tablas */
+
+
+static tabla_conc_t *tabla_crear(size_t capacidad){
+	tabla_conc_t *tabla = malloc(sizeof(tabla_conc_t) + sizeof(ranura_t) * capacidad);
+	if (!tabla) return NULL;
+
+	tabla->capacidad = capacidad;
+	for (size_t i = 0; i < capacidad; i++){
+		atomic_init(&tabla->ranuras[i].clave, NULL);
+		atomic_init(&tabla->ranuras[i].hash, 0);
+		atomic_init(&tabla->ranuras[i].valor, NULL);
+	}
+	return tabla;
+}
+
+
+static inline size_t posicion_inicial(size_t h, size_t capacidad){
+	// Los bits bajos del hash eligen el segmento; la posición usa los siguientes.
+	return (h >> BITS_SEGMENTO) & (capacidad - 1);
+}
+
+
+// Busca la ranura con la clave. La usan tanto los lectores (sin lock, así
+// que la tabla puede estar cambiando y el resultado se valida después con
+// la versión del segmento) como los escritores.
+static ranura_t *tabla_buscar(tabla_conc_t *tabla, const char *clave, size_t largo, size_t h){
+	size_t mascara = tabla->capacidad - 1;
+	size_t n = posicion_inicial(h, tabla->capacidad);
+
+	for (size_t i = 0; i < tabla->capacidad; i++, n = (n + 1) & mascara){
+		ranura_t *ranura = &tabla->ranuras[n];
+		clave_conc_t *actual = atomic_load_explicit(&ranura->clave, memory_order_acquire);
+		if (!actual) return NULL;
+		if (actual == BORRADA || atomic_load_explicit(&ranura->hash, memory_order_relaxed) != h) continue;
+		if (actual->largo == largo && !memcmp(actual->datos, clave, largo)) return ranura;
+	}
+	return NULL;
+}
+
+
+// Devuelve la primera ranura libre (vacía o borrada) de la secuencia de h.
+// Pre: se tiene el lock del segmento.
+static ranura_t *tabla_buscar_libre(tabla_conc_t *tabla, size_t h){
+	size_t mascara = tabla->capacidad - 1;
+	size_t n = posicion_inicial(h, tabla->capacidad);
+	while (true){
+		clave_conc_t *actual = atomic_load_explicit(&tabla->ranuras[n].clave, memory_order_relaxed);
+		if (!actual || actual == BORRADA) return &tabla->ranuras[n];
+		n = (n + 1) & mascara;
+	}
+}
+
+
+/* Segmentos */
+
+
+// Abre y cierra una escritura: mientras la versión es impar los lectores
+// saben que la tabla puede estar a medio modificar.
+static void escritura_comenzar(segmento_t *segmento){
+	unsigned version = atomic_load_explicit(&segmento->version, memory_order_relaxed);
+	atomic_store_explicit(&segmento->version, version + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+
+static void escritura_terminar(segmento_t *segmento){
+	unsigned version = atomic_load_explicit(&segmento->version, memory_order_relaxed);
+	atomic_store_explicit(&segmento->version, version + 1, memory_order_release);
+}
+
+
+// Reconstruye la tabla del segmento moviendo los punteros a las claves, sin
+// copiarlas. La tabla vieja se retira porque puede haber lectores en ella.
+// Pre: se tiene el lock del segmento.
+static bool segmento_redimensionar(hash_concurrente_t *hash, participante_t *p, segmento_t *segmento){
+	tabla_conc_t *vieja = atomic_load_explicit(&segmento->tabla, memory_order_relaxed);
+	size_t cantidad = atomic_load_explicit(&segmento->cantidad, memory_order_relaxed);
+	size_t capacidad = vieja->capacidad;
+	if (cantidad * 100 / capacidad >= FACTOR_CARGA_MAX / 2) capacidad *= FACTOR_REDIMENSION;
+
+	tabla_conc_t *nueva = tabla_crear(capacidad);
+	if (!nueva) return false;
+
+	for (size_t i = 0; i < vieja->capacidad; i++){
+		ranura_t *ranura = &vieja->ranuras[i];
+		clave_conc_t *clave = atomic_load_explicit(&ranura->clave, memory_order_relaxed);
+		if (!clave || clave == BORRADA) continue;
+		size_t h = atomic_load_explicit(&ranura->hash, memory_order_relaxed);
+		ranura_t *destino = tabla_buscar_libre(nueva, h);
+		atomic_store_explicit(&destino->hash, h, memory_order_relaxed);
+		atomic_store_explicit(&destino->valor, atomic_load_explicit(&ranura->valor, memory_order_relaxed), memory_order_relaxed);
+		atomic_store_explicit(&destino->clave, clave, memory_order_relaxed);
+	}
+
+	escritura_comenzar(segmento);
+	atomic_store_explicit(&segmento->tabla, nueva, memory_order_release);
+	escritura_terminar(segmento);
+	segmento->carga = cantidad;
+	retirar(hash, p, vieja, free);
+	return true;
+}
+
+
+/* Primitivas */
+
+
+hash_concurrente_t *hash_concurrente_crear(hash_destruir_dato_t destruir_dato){
+	hash_concurrente_t *hash = aligned_alloc(LINEA_CACHE, sizeof(hash_concurrente_t));
+	if (!hash) return NULL;
+
+	for (size_t i = 0; i < SEGMENTOS; i++){
+		segmento_t *segmento = &hash->segmentos[i];
+		tabla_conc_t *tabla = tabla_crear(TAM_INICIAL);
+		if (tabla && pthread_mutex_init(&segmento->mutex, NULL) != 0){
+			free(tabla);
+			tabla = NULL;
+		}
+		if (!tabla){
+			while (i-- > 0){
+				free(atomic_load(&hash->segmentos[i].tabla));
+				pthread_mutex_destroy(&hash->segmentos[i].mutex);
+			}
+			free(hash);
+			return NULL;
+		}
+		atomic_init(&segmento->version, 0);
+		atomic_init(&segmento->tabla, tabla);
+		atomic_init(&segmento->cantidad, 0);
+		segmento->carga = 0;
+	}
+
+	atomic_init(&hash->epoca, 0);
+	atomic_init(&hash->participantes, NULL);
+	hash->id = atomic_fetch_add(&proximo_id, 1);
+	hash->funcion_destruccion = destruir_dato;
+	hash->semilla = hash_generar_semilla(hash);
+	return hash;
+}
+
+
+void hash_concurrente_destruir(hash_concurrente_t *hash){
+	participante_t *p = atomic_load(&hash->participantes);
+	while (p){
+		participante_t *siguiente = p->siguiente;
+		for (size_t i = 0; i < 3; i++) liberar_lista(p->limbo[i]);
+		free(p);
+		p = siguiente;
+	}
+
+	for (size_t i = 0; i < SEGMENTOS; i++){
+		segmento_t *segmento = &hash->segmentos[i];
+		tabla_conc_t *tabla = atomic_load(&segmento->tabla);
+		for (size_t j = 0; j < tabla->capacidad; j++){
+			clave_conc_t *clave = atomic_load(&tabla->ranuras[j].clave);
+			if (!clave || clave == BORRADA) continue;
+			free(clave);
+			if (hash->funcion_destruccion) hash->funcion_destruccion(atomic_load(&tabla->ranuras[j].valor));
+		}
+		free(tabla);
+		pthread_mutex_destroy(&segmento->mutex);
+	}
+
+	if (id_cacheado == hash->id) id_cacheado = 0;
+	free(hash);
+}
+
+
+static segmento_t *segmento_de(const hash_concurrente_t *hash, size_t h){
+	return (segmento_t *)&hash->segmentos[h & (SEGMENTOS - 1)];
+}
+
+
+bool hash_concurrente_guardar(hash_concurrente_t *hash, const char *clave, void *dato){
+	size_t largo = strlen(clave);
+	size_t h = wyhash(clave, largo, hash->semilla);
+	segmento_t *segmento = segmento_de(hash, h);
+
+	pthread_mutex_lock(&segmento->mutex);
+	participante_t *p = entrar(hash);
+	tabla_conc_t *tabla = atomic_load_explicit(&segmento->tabla, memory_order_relaxed);
+
+	ranura_t *ranura = tabla_buscar(tabla, clave, largo, h);
+	if (ranura){
+		void *anterior = atomic_load_explicit(&ranura->valor, memory_order_relaxed);
+		escritura_comenzar(segmento);
+		atomic_store_explicit(&ranura->valor, dato, memory_order_relaxed);
+		escritura_terminar(segmento);
+		if (hash->funcion_destruccion) retirar(hash, p, anterior, hash->funcion_destruccion);
+		salir(p);
+		pthread_mutex_unlock(&segmento->mutex);
+		return true;
+	}
+
+	if ((segmento->carga + 1) * 100 / tabla->capacidad >= FACTOR_CARGA_MAX){
+		if (!segmento_redimensionar(hash, p, segmento)){
+			salir(p);
+			pthread_mutex_unlock(&segmento->mutex);
+			return false;
+		}
+		tabla = atomic_load_explicit(&segmento->tabla, memory_order_relaxed);
+	}
+
+	clave_conc_t *nueva = malloc(sizeof(clave_conc_t) + largo);
+	if (!nueva){
+		salir(p);
+		pthread_mutex_unlock(&segmento->mutex);
+		return false;
+	}
+	nueva->largo = largo;
+	memcpy(nueva->datos, clave, largo);
+
+	ranura = tabla_buscar_libre(tabla, h);
+	if (!atomic_load_explicit(&ranura->clave, memory_order_relaxed)) segmento->carga++;
+	escritura_comenzar(segmento);
+	atomic_store_explicit(&ranura->hash, h, memory_order_relaxed);
+	atomic_store_explicit(&ranura->valor, dato, memory_order_relaxed);
+	atomic_store_explicit(&ranura->clave, nueva, memory_order_release);
+	escritura_terminar(segmento);
+	atomic_fetch_add_explicit(&segmento->cantidad, 1, memory_order_relaxed);
+
+	salir(p);
+	pthread_mutex_unlock(&segmento->mutex);
+	return true;
+}
+
+
+void *hash_concurrente_borrar(hash_concurrente_t *hash, const char *clave){
+	size_t largo = strlen(clave);
+	size_t h = wyhash(clave, largo, hash->semilla);
+	segmento_t *segmento = segmento_de(hash, h);
+
+	pthread_mutex_lock(&segmento->mutex);
+	participante_t *p = entrar(hash);
+	tabla_conc_t *tabla = atomic_load_explicit(&segmento->tabla, memory_order_relaxed);
+
+	void *dato = NULL;
+	ranura_t *ranura = tabla_buscar(tabla, clave, largo, h);
+	if (ranura){
+		clave_conc_t *borrada = atomic_load_explicit(&ranura->clave, memory_order_relaxed);
+		dato = atomic_load_explicit(&ranura->valor, memory_order_relaxed);
+		escritura_comenzar(segmento);
+		atomic_store_explicit(&ranura->clave, BORRADA, memory_order_release);
+		escritura_terminar(segmento);
+		atomic_fetch_sub_explicit(&segmento->cantidad, 1, memory_order_relaxed);
+		retirar(hash, p, borrada, free);
+	}
+
+	salir(p);
+	pthread_mutex_unlock(&segmento->mutex);
+	return dato;
+}
+
+
+// Búsqueda sin lock. Si no pudo registrar al hilo para la recolección por
+// épocas, busca con el lock del segmento, que también impide que se libere
+// lo que está leyendo.
+static void *buscar_valor(const hash_concurrente_t *hash, const char *clave, bool *encontrada){
+	size_t largo = strlen(clave);
+	size_t h = wyhash(clave, largo, hash->semilla);
+	segmento_t *segmento = segmento_de(hash, h);
+
+	participante_t *p = entrar((hash_concurrente_t *)hash);
+	if (!p){
+		pthread_mutex_lock(&segmento->mutex);
+		ranura_t *ranura = tabla_buscar(atomic_load(&segmento->tabla), clave, largo, h);
+		void *valor = ranura ? atomic_load(&ranura->valor) : NULL;
+		pthread_mutex_unlock(&segmento->mutex);
+		*encontrada = ranura != NULL;
+		return valor;
+	}
+
+	while (true){
+		unsigned version = atomic_load_explicit(&segmento->version, memory_order_acquire);
+		if (version & 1){
+			pausa();
+			continue;
+		}
+		tabla_conc_t *tabla = atomic_load_explicit(&segmento->tabla, memory_order_acquire);
+		ranura_t *ranura = tabla_buscar(tabla, clave, largo, h);
+		void *valor = ranura ? atomic_load_explicit(&ranura->valor, memory_order_relaxed) : NULL;
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&segmento->version, memory_order_relaxed) == version){
+			salir(p);
+			*encontrada = ranura != NULL;
+			return valor;
+		}
+	}
+}
+
+
+void *hash_concurrente_obtener(const hash_concurrente_t *hash, const char *clave){
+	bool encontrada;
+	return buscar_valor(hash, clave, &encontrada);
+}
+
+
+bool hash_concurrente_pertenece(const hash_concurrente_t *hash, const char *clave){
+	bool encontrada;
+	buscar_valor(hash, clave, &encontrada);
+	return encontrada;
+}
+
+
+size_t hash_concurrente_cantidad(const hash_concurrente_t *hash){
+	size_t cantidad = 0;
+	for (size_t i = 0; i < SEGMENTOS; i++) cantidad += atomic_load_explicit(&hash->segmentos[i].cantidad, memory_order_relaxed);
+	return cantidad;
+}
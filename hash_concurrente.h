@@ -0,0 +1,74 @@
+#ifndef HASH_CONCURRENTE_H
+#define HASH_CONCURRENTE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "hash.h"
+
+/* Hash con las mismas primitivas que hash.h que puede usarse desde varios
+ * hilos a la vez sin sincronización externa.
+ *
+ * Las claves se reparten en segmentos, cada uno con su propia tabla. Las
+ * escrituras toman solo el lock del segmento de la clave, así que
+ * escrituras sobre segmentos distintos no se bloquean entre sí; cada
+ * segmento se redimensiona por separado. Las lecturas no toman ningún
+ * lock: leen la tabla de forma optimista y la validan con un contador de
+ * versión del segmento, reintentando si hubo una escritura en el medio.
+ * La memoria que deja de usarse (tablas viejas, claves borradas y datos
+ * reemplazados) se libera recién cuando ningún hilo puede estar leyéndola.
+ * Para eso cada hilo que usa el hash se registra la primera vez y su
+ * registro (con la memoria que tenga pendiente de liberar) queda hasta
+ * hash_concurrente_destruir, aunque el hilo termine antes: un hash que
+ * pasa por muchos hilos de corta vida crece con cada uno.
+ */
+
+struct hash_concurrente;
+typedef struct hash_concurrente hash_concurrente_t;
+
+/* Crea el hash
+ */
+hash_concurrente_t *hash_concurrente_crear(hash_destruir_dato_t destruir_dato);
+
+/* Guarda un elemento en el hash, si la clave ya se encuentra en la
+ * estructura, la reemplaza. De no poder guardarlo devuelve false.
+ * El dato reemplazado se destruye cuando ningún hilo puede estar
+ * leyéndolo dentro del hash; no debe usarse después de reemplazarlo.
+ * Pre: La estructura hash fue inicializada
+ * Post: Se almacenó el par (clave, dato)
+ */
+bool hash_concurrente_guardar(hash_concurrente_t *hash, const char *clave, void *dato);
+
+/* Borra un elemento del hash y devuelve el dato asociado.  Devuelve
+ * NULL si el dato no estaba. Otros hilos pueden haber obtenido el dato
+ * antes del borrado y seguir usándolo.
+ * Pre: La estructura hash fue inicializada
+ * Post: El elemento fue borrado de la estructura y se lo devolvió,
+ * en el caso de que estuviera guardado.
+ */
+void *hash_concurrente_borrar(hash_concurrente_t *hash, const char *clave);
+
+/* Obtiene el valor de un elemento del hash, si la clave no se encuentra
+ * devuelve NULL. No toma ningún lock.
+ * Pre: La estructura hash fue inicializada
+ */
+void *hash_concurrente_obtener(const hash_concurrente_t *hash, const char *clave);
+
+/* Determina si clave pertenece o no al hash. No toma ningún lock.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_concurrente_pertenece(const hash_concurrente_t *hash, const char *clave);
+
+/* Devuelve la cantidad de elementos del hash. Si hay escrituras en curso
+ * el resultado es aproximado.
+ * Pre: La estructura hash fue inicializada
+ */
+size_t hash_concurrente_cantidad(const hash_concurrente_t *hash);
+
+/* Destruye la estructura liberando la memoria pedida y llamando a la función
+ * destruir para cada par (clave, dato).
+ * Pre: La estructura hash fue inicializada y ningún otro hilo la está usando
+ * Post: La estructura hash fue destruida
+ */
+void hash_concurrente_destruir(hash_concurrente_t *hash);
+
+#endif  // HASH_CONCURRENTE_H
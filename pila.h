@@ -37,4 +37,6 @@ void *pila_ver_tope(const pila_t *pila);
 // Pre: la pila fue creada.
 // Post: si la pila no estaba vacía, se devuelve el valor del tope anterior
 // y la pila contiene un elemento menos.
-void *pila_desapilar(pila_t *pila);
\ No newline at end of file
+void *pila_desapilar(pila_t *pila);
+
+#endif  // _PILA_H